@@ -0,0 +1,149 @@
+#define FPC_IMPLEMENTATION
+// Streaming runs as a mode of its own: "streaming_min_size" stays at (size_t)-1 except
+// while the flat-stream mode runs the public entry points with it at 0.
+#define FPC_STREAMING
+#define FPC_STREAMING_MIN_SIZE streaming_min_size
+#include <stddef.h>
+size_t streaming_min_size = (size_t)-1;
+#include "fpc.h"
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define VALUE_COUNT (1 << 23)
+#define TABLE_SIZE (1 << 20)
+#define RUN_COUNT 3
+
+typedef size_t (*encode_fn_t)(fpc_context_ptr_t, const double*, size_t, void*);
+typedef size_t (*decode_fn_t)(fpc_context_ptr_t, const void*, double*, size_t);
+
+double source[VALUE_COUNT];
+uint8_t encoded[FPC_UPPER_BOUND(VALUE_COUNT)];
+double decoded[VALUE_COUNT];
+uint64_t fcm[TABLE_SIZE];
+uint64_t dfcm[TABLE_SIZE];
+
+double now()
+{
+  struct timespec t;
+  timespec_get(&t, TIME_UTC);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+size_t encode_flat(fpc_context_ptr_t ctx, const double* in, size_t count, void* out)
+{
+  return fpc_encode(ctx, in, count, out);
+}
+
+size_t decode_flat(fpc_context_ptr_t ctx, const void* in, double* out, size_t count)
+{
+  return fpc_decode(ctx, in, out, count);
+}
+
+size_t encode_adaptive(fpc_context_ptr_t ctx, const double* in, size_t count, void* out)
+{
+  return fpc_encode_blocks_adaptive(ctx, in, count, 0, out);
+}
+
+#ifdef FPC_STREAMING
+size_t encode_stream(fpc_context_ptr_t ctx, const double* in, size_t count, void* out)
+{
+  size_t size;
+  streaming_min_size = 0;
+  size = fpc_encode(ctx, in, count, out);
+  streaming_min_size = (size_t)-1;
+  return size;
+}
+
+size_t decode_stream(fpc_context_ptr_t ctx, const void* in, double* out, size_t count)
+{
+  size_t size;
+  streaming_min_size = 0;
+  size = fpc_decode(ctx, in, out, count);
+  streaming_min_size = (size_t)-1;
+  return size;
+}
+#endif
+
+void run(
+  const char* data_name,
+  const char* mode_name,
+  encode_fn_t encode,
+  decode_fn_t decode)
+{
+  fpc_context_t c;
+  size_t i, r, encoded_size;
+  double t, encode_time, decode_time;
+  const double size = (double)VALUE_COUNT * sizeof(double);
+
+  fpc_context_init_default(&c, fcm, dfcm, TABLE_SIZE, TABLE_SIZE);
+  encode_time = decode_time = 1e9;
+  encoded_size = 0;
+  for (r = 0; r != RUN_COUNT; ++r)
+  {
+    fpc_context_reset(&c);
+    t = now();
+    encoded_size = encode(&c, source, VALUE_COUNT, encoded);
+    t = now() - t;
+    if (t < encode_time)
+      encode_time = t;
+
+    fpc_context_reset(&c);
+    t = now();
+    (void)decode(&c, encoded, decoded, VALUE_COUNT);
+    t = now() - t;
+    if (t < decode_time)
+      decode_time = t;
+  }
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+  {
+    if (source[i] != decoded[i])
+    {
+      printf("%-8s %-12s roundtrip failed at %llu\n", data_name, mode_name, (unsigned long long)i);
+      exit(1);
+    }
+  }
+
+  printf("%-8s %-12s ratio %f, encode %8.1f MB/s, decode %8.1f MB/s\n",
+    data_name, mode_name,
+    (double)encoded_size / size,
+    size / encode_time / 1e6,
+    size / decode_time / 1e6);
+}
+
+void run_all(const char* data_name)
+{
+  run(data_name, "flat", encode_flat, decode_flat);
+#ifdef FPC_STREAMING
+  run(data_name, "flat-stream", encode_stream, decode_stream);
+#endif
+  run(data_name, "blocks", fpc_encode_blocks, fpc_decode_blocks);
+  run(data_name, "blocks-fast", fpc_encode_blocks_fast, fpc_decode_blocks);
+  run(data_name, "adaptive", encode_adaptive, fpc_decode_blocks_adaptive);
+}
+
+int main(
+  int argc,
+  const char** argv)
+{
+  size_t i;
+  (void)argc;
+  (void)argv;
+
+  srand(1234);
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source[i] = (double)rand() / (double)rand();
+  run_all("noise");
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source[i] = sin((double)i * 0.001) * 1000.0;
+  run_all("smooth");
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source[i] = (double)((i / 64) % 97) * 0.25 + (double)(i % 7);
+  run_all("pattern");
+
+  return 0;
+}
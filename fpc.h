@@ -28,6 +28,12 @@
 #ifndef FPC_INCLUDED
 #define FPC_INCLUDED
 
+#if defined(FPC_IMPLEMENTATION) && !defined(FPC_NO_ALLOCATOR) && defined(__linux__) && !defined(_DEFAULT_SOURCE)
+  // mmap flags and syscall() are hidden by strict -std=c99/c11 modes. This only works when
+  // fpc.h comes before any system header in the implementation file.
+  #define _DEFAULT_SOURCE
+#endif
+
 #include <stdint.h>
 #include <stddef.h>
 
@@ -58,6 +64,46 @@
 #define FPC32_UPPER_BOUND(COUNT) FPC32_UPPER_BOUND_METADATA((COUNT)) + FPC32_UPPER_BOUND_DATA((COUNT))
 #define FPC32_DEFAULT_HASH_ARGS { 1, 22, 4, 23 }
 
+#define FPC_DICTIONARY_HEADER_SIZE 4
+#define FPC_DICTIONARY_UPPER_BOUND(COUNT) (FPC_DICTIONARY_HEADER_SIZE + FPC_UPPER_BOUND((COUNT)))
+#define FPC32_DICTIONARY_UPPER_BOUND(COUNT) (FPC_DICTIONARY_HEADER_SIZE + FPC32_UPPER_BOUND((COUNT)))
+
+// Values per block in the block container. Each block starts with one of the FPC_BLOCK_* markers.
+#define FPC_BLOCK_COUNT 512
+#define FPC_BLOCK_RAW 0
+#define FPC_BLOCK_FPC 1
+#define FPC_BLOCK_FCM 2
+#define FPC_BLOCK_DFCM 3
+// Flags on adaptive block markers: the context is reset before the block, and a raw
+// block updates the tables as if it had been encoded.
+#define FPC_BLOCK_RESET 0x40
+#define FPC_BLOCK_SEED 0x80
+#define FPC_BLOCK_UPPER_BOUND(COUNT) \
+  ((size_t)(COUNT) * 8 + ((size_t)(COUNT) + FPC_BLOCK_COUNT - 1) / FPC_BLOCK_COUNT)
+#define FPC32_BLOCK_UPPER_BOUND(COUNT) \
+  ((size_t)(COUNT) * 4 + ((size_t)(COUNT) + FPC_BLOCK_COUNT - 1) / FPC_BLOCK_COUNT)
+
+// Reference snapshot streams: 2-bit predictor selectors, then FPC-style headers and data.
+#define FPC_REF_TYPES_SIZE(COUNT) ((size_t)((COUNT) + 3) / 4)
+#define FPC_REF_UPPER_BOUND(COUNT) (FPC_REF_TYPES_SIZE((COUNT)) + FPC_UPPER_BOUND((COUNT)))
+#define FPC32_REF_UPPER_BOUND(COUNT) (FPC_REF_TYPES_SIZE((COUNT)) + FPC32_UPPER_BOUND((COUNT)))
+
+// Grids of up to FPC_GRID_MAX_DIMS dimensions are encoded in tiles of at most
+// FPC_GRID_TILE_COUNT values. TILES is the value returned by fpc_grid_tile_count.
+#define FPC_GRID_MAX_DIMS 3
+#define FPC_GRID_TILE_COUNT 4096
+#define FPC_GRID_UPPER_BOUND(COUNT, TILES) (FPC_REF_UPPER_BOUND((COUNT)) + (size_t)(TILES) * 2)
+#define FPC32_GRID_UPPER_BOUND(COUNT, TILES) (FPC32_REF_UPPER_BOUND((COUNT)) + (size_t)(TILES) * 2)
+#define FPC_GRID_TILE_UPPER_BOUND FPC_REF_UPPER_BOUND(FPC_GRID_TILE_COUNT)
+#define FPC32_GRID_TILE_UPPER_BOUND FPC32_REF_UPPER_BOUND(FPC_GRID_TILE_COUNT)
+
+#define FPC_CHECKPOINT_VERSION 1
+#define FPC_CHECKPOINT_COMPRESS 1
+#define FPC_CHECKPOINT_UPPER_BOUND(FCM_SIZE, DFCM_SIZE) \
+  ((size_t)48 + FPC_UPPER_BOUND((FCM_SIZE)) + FPC_UPPER_BOUND((DFCM_SIZE)))
+#define FPC32_CHECKPOINT_UPPER_BOUND(FCM_SIZE, DFCM_SIZE) \
+  ((size_t)28 + FPC32_UPPER_BOUND((FCM_SIZE)) + FPC32_UPPER_BOUND((DFCM_SIZE)))
+
 typedef struct fpc_hash_args_t
 {
   uint8_t fcm_lshift;
@@ -78,6 +124,12 @@ typedef struct fpc_context_t
   double delta_seed;
   // Custom options for the FCM and DFCM hash functions.
   fpc_hash_args_t hash_args;
+  // Rolling predictor state. Carried over between calls until the next reset.
+  uint64_t fcm_hash;
+  uint64_t dfcm_hash;
+  uint64_t fcm_prediction;
+  uint64_t dfcm_prediction;
+  uint64_t last;
 } fpc_context_t;
 
 typedef fpc_context_t* FPC_RESTRICT fpc_context_ptr_t;
@@ -94,10 +146,96 @@ typedef struct fpc32_context_t
   float delta_seed;
   // Custom options for the FCM and DFCM hash functions.
   fpc_hash_args_t hash_args;
+  // Rolling predictor state. Carried over between calls until the next reset.
+  uint32_t fcm_hash;
+  uint32_t dfcm_hash;
+  uint32_t fcm_prediction;
+  uint32_t dfcm_prediction;
+  uint32_t last;
 } fpc32_context_t;
 
 typedef fpc32_context_t* FPC_RESTRICT fpc32_context_ptr_t;
 
+// Resizes "block" to "size" bytes, like realloc. Returns NULL on failure.
+typedef void* (FPC_CALL* fpc_realloc_fn_t)(void* user_data, void* block, size_t size);
+
+typedef struct fpc_buffer_t
+{
+  void* data;
+  // The number of bytes in use. Encoding appends after them.
+  size_t size;
+  // The number of bytes allocated.
+  size_t capacity;
+  // Allocator used to grow "data". Defaults to FPC_REALLOC if NULL.
+  fpc_realloc_fn_t realloc_fn;
+  void* user_data;
+} fpc_buffer_t;
+
+// Returned by fpc_encode_buffer and fpc32_encode_buffer when the allocator fails.
+#define FPC_BUFFER_ERROR ((size_t)-1)
+
+typedef struct fpc_dictionary_t
+{
+  // Primed table images, usually the tables of a context passed to fpc_dictionary_train.
+  const uint64_t* FPC_RESTRICT fcm;
+  const uint64_t* FPC_RESTRICT dfcm;
+  // The size, in elements, of the array pointed to by "fcm".
+  size_t fcm_size;
+  // The size, in elements, of the array pointed to by "dfcm".
+  size_t dfcm_size;
+  // Identifier stored in front of every message encoded with this dictionary.
+  uint32_t id;
+} fpc_dictionary_t;
+
+typedef struct fpc32_dictionary_t
+{
+  const uint32_t* FPC_RESTRICT fcm;
+  const uint32_t* FPC_RESTRICT dfcm;
+  size_t fcm_size;
+  size_t dfcm_size;
+  uint32_t id;
+} fpc32_dictionary_t;
+
+typedef struct fpc_estimate_t
+{
+  // Estimated encoded size divided by the input size, and the bounds of its 95%
+  // confidence interval.
+  double ratio;
+  double ratio_low;
+  double ratio_high;
+  // Estimated fraction of blocks fpc_encode_blocks would store raw.
+  double raw_block_fraction;
+  // Measured encoding and decoding time per value, in nanoseconds. Zero without a clock.
+  double encode_ns;
+  double decode_ns;
+  // The number of values run through the predictor, warm-up included.
+  size_t sampled_count;
+} fpc_estimate_t;
+
+#ifndef FPC_NO_ALLOCATOR
+// Recycled contexts keep the tables and state left by their last user unless this is set.
+#define FPC_POOL_RESET 1
+
+// Thread-safe free list of contexts sharing the same table sizes.
+typedef struct fpc_context_pool_t
+{
+  size_t fcm_size;
+  size_t dfcm_size;
+  // Released contexts, ready to be handed out again.
+  void* free_list;
+  // Spin lock guarding "free_list".
+  volatile long lock;
+} fpc_context_pool_t;
+
+typedef struct fpc32_context_pool_t
+{
+  size_t fcm_size;
+  size_t dfcm_size;
+  void* free_list;
+  volatile long lock;
+} fpc32_context_pool_t;
+#endif
+
 FPC_ATTR void FPC_CALL fpc_context_init(
   fpc_context_ptr_t ctx,
   uint64_t* FPC_RESTRICT fcm,
@@ -117,6 +255,58 @@ FPC_ATTR void FPC_CALL fpc_context_init_default(
 FPC_ATTR void FPC_CALL fpc_context_reset(
   fpc_context_ptr_t ctx);
 
+#ifndef FPC_NO_ALLOCATOR
+// Allocates a context with zeroed tables and default hash arguments. On Linux, tables
+// of at least FPC_HUGE_PAGE_SIZE bytes are backed by huge pages and bound to the NUMA node
+// of the calling thread at this point. Returns NULL on failure.
+FPC_ATTR fpc_context_t* FPC_CALL fpc_context_create(
+  size_t fcm_size,
+  size_t dfcm_size);
+
+// Frees a context returned by fpc_context_create or fpc_context_pool_acquire.
+FPC_ATTR void FPC_CALL fpc_context_destroy(
+  fpc_context_t* ctx);
+
+FPC_ATTR void FPC_CALL fpc_context_pool_init(
+  fpc_context_pool_t* pool,
+  size_t fcm_size,
+  size_t dfcm_size);
+
+// Takes a released context from "pool", or creates one if there is none. Pass
+// FPC_POOL_RESET in "flags" to clear the tables and state of a recycled context.
+// Returns NULL on failure.
+FPC_ATTR fpc_context_t* FPC_CALL fpc_context_pool_acquire(
+  fpc_context_pool_t* pool,
+  uint32_t flags);
+
+// Hands "ctx" back to "pool". Safe to call concurrently with fpc_context_pool_acquire.
+FPC_ATTR void FPC_CALL fpc_context_pool_release(
+  fpc_context_pool_t* pool,
+  fpc_context_t* ctx);
+
+// Destroys the contexts held by "pool". Contexts still acquired must be destroyed by
+// their owners.
+FPC_ATTR void FPC_CALL fpc_context_pool_destroy(
+  fpc_context_pool_t* pool);
+#endif
+
+// Serializes the tables and the rolling predictor state of "ctx" into "out".
+// "flags" may contain FPC_CHECKPOINT_COMPRESS. Returns the number of bytes written,
+// which is never larger than FPC_CHECKPOINT_UPPER_BOUND(ctx->fcm_size, ctx->dfcm_size).
+FPC_ATTR size_t FPC_CALL fpc_context_save(
+  fpc_context_ptr_t ctx,
+  uint32_t flags,
+  void* FPC_RESTRICT out);
+
+// Restores a checkpoint written by fpc_context_save. The table sizes of "ctx" must
+// match the ones of the saved context. Returns the number of bytes read, or 0 if the
+// checkpoint is malformed, truncated or not compatible with "ctx", in which case "ctx" is
+// left untouched. At most "in_size" bytes are read.
+FPC_ATTR size_t FPC_CALL fpc_context_load(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  size_t in_size);
+
 FPC_ATTR size_t FPC_CALL fpc_encode_size(
   fpc_context_ptr_t ctx,
   const double* FPC_RESTRICT in,
@@ -135,19 +325,229 @@ FPC_ATTR size_t FPC_CALL fpc_encode_separate(
   void* FPC_RESTRICT out_headers,
   void* FPC_RESTRICT out_data);
 
-FPC_ATTR void FPC_CALL fpc_decode(
+// Single-pass fpc_encode into a growable buffer. The output is appended to "out", grows
+// geometrically and ends up with the same layout as fpc_encode. Returns the number of
+// bytes appended, which is 0 for an empty input, or FPC_BUFFER_ERROR if the allocator
+// failed. On failure "out->size" is unchanged, but "ctx" has already gone over part of
+// "in", so it must be reset or reloaded from a checkpoint before it is used again.
+FPC_ATTR size_t FPC_CALL fpc_encode_buffer(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  fpc_buffer_t* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc_decode(
   fpc_context_ptr_t ctx,
   const void* FPC_RESTRICT in,
   double* FPC_RESTRICT out,
   size_t out_count);
 
-FPC_ATTR void FPC_CALL fpc_decode_separate(
+FPC_ATTR size_t FPC_CALL fpc_decode_separate(
   fpc_context_ptr_t ctx,
   const void* FPC_RESTRICT headers,
   const void* FPC_RESTRICT in,
   double* FPC_RESTRICT out,
   size_t out_count);
 
+// Encodes "in" as a sequence of blocks of FPC_BLOCK_COUNT values. Blocks that FPC would
+// shrink by less than 1 / 2^FPC_BLOCK_MIN_GAIN_SHIFT are stored raw and leave the
+// predictor state untouched, so they decode at memcpy speed. The output never exceeds
+// FPC_BLOCK_UPPER_BOUND(count) bytes. Returns the number of bytes written.
+FPC_ATTR size_t FPC_CALL fpc_encode_blocks(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+// Speed-first fpc_encode_blocks. Each block runs only the predictor, FCM or DFCM, that
+// does best on a sample of the block, halving the table traffic for some loss of ratio.
+// The output has the same bound and is read by fpc_decode_blocks.
+FPC_ATTR size_t FPC_CALL fpc_encode_blocks_fast(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+// Decodes the output of fpc_encode_blocks and fpc_encode_blocks_fast. Returns the number
+// of bytes read.
+FPC_ATTR size_t FPC_CALL fpc_decode_blocks(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count);
+
+// fpc_encode_blocks that follows regime changes, seen as a block much larger than the
+// recent ones. After a regime change, and at the start, blocks stored raw still update
+// the tables, for up to "ctx->fcm_size" values, so data that does not compress the first
+// time it is seen is predicted when it comes back. Such blocks carry FPC_BLOCK_SEED. If
+// "restart_count" is not 0, the context is reset at the first regime change at least
+// "restart_count" values after the previous restart point, or after twice as many values
+// at the latest. These blocks carry FPC_BLOCK_RESET and decoding can start at them, see
+// fpc_blocks_find_restart. The output has the same bound as fpc_encode_blocks.
+FPC_ATTR size_t FPC_CALL fpc_encode_blocks_adaptive(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  size_t restart_count,
+  void* FPC_RESTRICT out);
+
+// Decodes the output of fpc_encode_blocks_adaptive. "out_count" must reach the end of the
+// stream or a multiple of FPC_BLOCK_COUNT values. Returns the number of bytes read.
+FPC_ATTR size_t FPC_CALL fpc_decode_blocks_adaptive(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count);
+
+// Finds the last restart point at or before value "index" in the output of
+// fpc_encode_blocks_adaptive, holding "count" values, reading only block markers and
+// headers. Returns the byte offset of its block and stores the index of its first value
+// in "restart_index". Without one, returns 0 and stores 0. Decoding with
+// fpc_decode_blocks_adaptive can start there with any context of the same table sizes.
+FPC_ATTR size_t FPC_CALL fpc_blocks_find_restart(
+  const void* FPC_RESTRICT in,
+  size_t count,
+  size_t index,
+  size_t* FPC_RESTRICT restart_index);
+
+// Encodes "frames" frames of "nchannels" interleaved values. Channel "c" is predicted with
+// its own tables and state from "ctxs[c]", so unrelated channels do not disturb each
+// other. The output has the same layout as fpc_encode, at most
+// FPC_UPPER_BOUND(frames * nchannels) bytes. Returns the number of bytes written.
+FPC_ATTR size_t FPC_CALL fpc_encode_channels(
+  fpc_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const double* FPC_RESTRICT in,
+  size_t frames,
+  void* FPC_RESTRICT out);
+
+// Decodes the output of fpc_encode_channels back into interleaved frames. Returns the
+// number of bytes read.
+FPC_ATTR size_t FPC_CALL fpc_decode_channels(
+  fpc_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t frames);
+
+// Estimates how well "in" compresses by encoding and decoding evenly spread windows of
+// FPC_BLOCK_COUNT values, each after a short warm-up, covering about "sample_fraction" of
+// the input, clamped to [0, 1]. At 1, the estimate is the exact ratio when "count" is a
+// multiple of FPC_BLOCK_COUNT; otherwise the "count % FPC_BLOCK_COUNT" values left over
+// only warm up the tables or are skipped. "ctx" is reset and used as scratch.
+FPC_ATTR void FPC_CALL fpc_estimate(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  double sample_fraction,
+  fpc_estimate_t* FPC_RESTRICT est);
+
+// Encodes "in" against a reference snapshot "ref" of the same length, usually the previous
+// time step. Each value picks the closest of the FCM, DFCM, "ref[i]" and
+// "ref[i] + (in[i - 1] - ref[i - 1])" predictions. The snapshot predictors only look at
+// the current call, so disjoint ranges can be encoded in parallel, each with its own
+// context. Returns the number of bytes written, at most FPC_REF_UPPER_BOUND(count).
+FPC_ATTR size_t FPC_CALL fpc_encode_ref(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  const double* FPC_RESTRICT ref,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+// Decodes the output of fpc_encode_ref, given the same reference snapshot. Returns the
+// number of bytes read.
+FPC_ATTR size_t FPC_CALL fpc_decode_ref(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const double* FPC_RESTRICT ref,
+  double* FPC_RESTRICT out,
+  size_t out_count);
+
+// Returns the number of tiles a grid is split into. "dims" lists the extents of the grid
+// from the slowest to the fastest varying axis, as in a C array declaration.
+FPC_ATTR size_t FPC_CALL fpc_grid_tile_count(
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims);
+
+// Encodes a row-major grid of 1 to FPC_GRID_MAX_DIMS dimensions tile by tile. Each value
+// picks the closest of the FCM, DFCM and Lorenzo predictions, the latter summing the
+// already visited neighbours of the value within its tile. The tiles carry on the rolling
+// state of "ctx" and are not indexed, so the output can only be decoded from the start,
+// with fpc_decode_grid; see fpc_encode_grid_tile for tiles that decode on their own.
+// Returns the number of bytes written, at most
+// FPC_GRID_UPPER_BOUND(count, fpc_grid_tile_count(dims, ndims)).
+FPC_ATTR size_t FPC_CALL fpc_encode_grid(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  void* FPC_RESTRICT out);
+
+// Decodes the output of fpc_encode_grid. Returns the number of bytes read.
+FPC_ATTR size_t FPC_CALL fpc_decode_grid(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  double* FPC_RESTRICT out);
+
+// Encodes a single tile of a grid, at most FPC_GRID_TILE_UPPER_BOUND bytes. Tiles do not
+// depend on each other, so they can be encoded and decoded in parallel, one context each.
+FPC_ATTR size_t FPC_CALL fpc_encode_grid_tile(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile,
+  void* FPC_RESTRICT out);
+
+// Decodes a single tile into its place in "out". Returns the number of bytes read.
+FPC_ATTR size_t FPC_CALL fpc_decode_grid_tile(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile,
+  double* FPC_RESTRICT out);
+
+// Resets "ctx" and primes its tables with the given sample messages. Every sample starts
+// from a fresh rolling state, like the messages later encoded with the dictionary.
+FPC_ATTR void FPC_CALL fpc_dictionary_train(
+  fpc_context_ptr_t ctx,
+  const double* const* FPC_RESTRICT samples,
+  const size_t* FPC_RESTRICT sample_counts,
+  size_t sample_count);
+
+// Copies the table images of "dict" into "ctx" and resets the rolling state.
+FPC_ATTR void FPC_CALL fpc_context_load_dictionary(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict);
+
+// Returns the identifier of the dictionary a message was encoded with.
+FPC_ATTR uint32_t FPC_CALL fpc_dictionary_id(
+  const void* FPC_RESTRICT in);
+
+// Encodes a message with the dictionary installed, prefixed by the dictionary identifier.
+// "ctx" must hold the tables of "dict", see fpc_context_load_dictionary, and holds them
+// again on return: only the table slots the message wrote are copied back, so the cost
+// does not depend on the table sizes.
+FPC_ATTR size_t FPC_CALL fpc_encode_dictionary(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+// Decodes a message written by fpc_encode_dictionary, with "ctx" holding the tables of
+// "dict" as for fpc_encode_dictionary. Returns the number of bytes read, or 0 if the
+// message was encoded with a different dictionary, in which case "ctx" is untouched.
+FPC_ATTR size_t FPC_CALL fpc_decode_dictionary(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count);
+
 FPC_ATTR void FPC_CALL fpc32_context_init(
   fpc32_context_ptr_t ctx,
   uint32_t* FPC_RESTRICT fcm,
@@ -167,6 +567,41 @@ FPC_ATTR void FPC_CALL fpc32_context_init_default(
 FPC_ATTR void FPC_CALL fpc32_context_reset(
   fpc32_context_ptr_t ctx);
 
+#ifndef FPC_NO_ALLOCATOR
+FPC_ATTR fpc32_context_t* FPC_CALL fpc32_context_create(
+  size_t fcm_size,
+  size_t dfcm_size);
+
+FPC_ATTR void FPC_CALL fpc32_context_destroy(
+  fpc32_context_t* ctx);
+
+FPC_ATTR void FPC_CALL fpc32_context_pool_init(
+  fpc32_context_pool_t* pool,
+  size_t fcm_size,
+  size_t dfcm_size);
+
+FPC_ATTR fpc32_context_t* FPC_CALL fpc32_context_pool_acquire(
+  fpc32_context_pool_t* pool,
+  uint32_t flags);
+
+FPC_ATTR void FPC_CALL fpc32_context_pool_release(
+  fpc32_context_pool_t* pool,
+  fpc32_context_t* ctx);
+
+FPC_ATTR void FPC_CALL fpc32_context_pool_destroy(
+  fpc32_context_pool_t* pool);
+#endif
+
+FPC_ATTR size_t FPC_CALL fpc32_context_save(
+  fpc32_context_ptr_t ctx,
+  uint32_t flags,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_context_load(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  size_t in_size);
+
 FPC_ATTR size_t FPC_CALL fpc32_encode_size(
   fpc32_context_ptr_t ctx,
   const float* FPC_RESTRICT in,
@@ -185,15 +620,162 @@ FPC_ATTR size_t FPC_CALL fpc32_encode(
   size_t count,
   void* FPC_RESTRICT out);
 
-FPC_ATTR void FPC_CALL fpc32_decode_separate(
+FPC_ATTR size_t FPC_CALL fpc32_encode_buffer(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  fpc_buffer_t* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_separate(
   fpc32_context_ptr_t ctx,
   const void* FPC_RESTRICT headers,
   const void* FPC_RESTRICT in,
   float* FPC_RESTRICT out,
   size_t out_count);
 
-FPC_ATTR void FPC_CALL fpc32_decode(
+FPC_ATTR size_t FPC_CALL fpc32_decode(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_blocks(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_blocks_fast(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_blocks(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count);
+
+// fpc32_encode_blocks that follows regime changes, seen as a block much larger than the
+// recent ones. After a regime change, and at the start, blocks stored raw still update
+// the tables, for up to "ctx->fcm_size" values, so data that does not compress the first
+// time it is seen is predicted when it comes back. Such blocks carry FPC_BLOCK_SEED. If
+// "restart_count" is not 0, the context is reset at the first regime change at least
+// "restart_count" values after the previous restart point, or after twice as many values
+// at the latest. These blocks carry FPC_BLOCK_RESET and decoding can start at them, see
+// fpc32_blocks_find_restart. The output has the same bound as fpc32_encode_blocks.
+FPC_ATTR size_t FPC_CALL fpc32_encode_blocks_adaptive(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  size_t restart_count,
+  void* FPC_RESTRICT out);
+
+// Decodes the output of fpc32_encode_blocks_adaptive. "out_count" must reach the end of the
+// stream or a multiple of FPC_BLOCK_COUNT values. Returns the number of bytes read.
+FPC_ATTR size_t FPC_CALL fpc32_decode_blocks_adaptive(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count);
+
+// Finds the last restart point at or before value "index" in the output of
+// fpc32_encode_blocks_adaptive, holding "count" values, reading only block markers and
+// headers. Returns the byte offset of its block and stores the index of its first value
+// in "restart_index". Without one, returns 0 and stores 0. Decoding with
+// fpc32_decode_blocks_adaptive can start there with any context of the same table sizes.
+FPC_ATTR size_t FPC_CALL fpc32_blocks_find_restart(
+  const void* FPC_RESTRICT in,
+  size_t count,
+  size_t index,
+  size_t* FPC_RESTRICT restart_index);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_channels(
+  fpc32_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const float* FPC_RESTRICT in,
+  size_t frames,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_channels(
+  fpc32_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t frames);
+
+FPC_ATTR void FPC_CALL fpc32_estimate(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  double sample_fraction,
+  fpc_estimate_t* FPC_RESTRICT est);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_ref(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  const float* FPC_RESTRICT ref,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_ref(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const float* FPC_RESTRICT ref,
+  float* FPC_RESTRICT out,
+  size_t out_count);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_grid(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_grid(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  float* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_grid_tile(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_grid_tile(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile,
+  float* FPC_RESTRICT out);
+
+FPC_ATTR void FPC_CALL fpc32_dictionary_train(
+  fpc32_context_ptr_t ctx,
+  const float* const* FPC_RESTRICT samples,
+  const size_t* FPC_RESTRICT sample_counts,
+  size_t sample_count);
+
+FPC_ATTR void FPC_CALL fpc32_context_load_dictionary(
+  fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict);
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_dictionary(
+  fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out);
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_dictionary(
   fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict,
   const void* FPC_RESTRICT in,
   float* FPC_RESTRICT out,
   size_t out_count);
@@ -204,6 +786,9 @@ FPC_ATTR void FPC_CALL fpc32_decode(
 
 #ifdef FPC_IMPLEMENTATION
 
+#include <float.h>
+#include <time.h>
+
 #if __has_include(<stdbool.h>)
   #include <stdbool.h>
   #define FPC_BOOL bool
@@ -244,10 +829,10 @@ FPC_ATTR void FPC_CALL fpc32_decode(
       #define FPC_LOAD_NT_U32(P) FPC_LOAD_NT((const uint32_t* FPC_RESTRICT)(P))
       #define FPC_LOAD_NT_U64(P) FPC_LOAD_NT((const uint64_t* FPC_RESTRICT)(P))
     #endif
-    #if __has_builtin(__builtin_nontemporal_load)
+    #if __has_builtin(__builtin_nontemporal_store)
       #define FPC_STORE_NT(P, V) __builtin_nontemporal_store(V, P)
-      #define FPC_STORE_NT_U32(P, V) FPC_STORE_NT((const uint32_t* FPC_RESTRICT)(P), (V))
-      #define FPC_STORE_NT_U64(P, V) FPC_STORE_NT((const uint64_t* FPC_RESTRICT)(P), (V))
+      #define FPC_STORE_NT_U32(P, V) FPC_STORE_NT((uint32_t* FPC_RESTRICT)(P), (V))
+      #define FPC_STORE_NT_U64(P, V) FPC_STORE_NT((uint64_t* FPC_RESTRICT)(P), (V))
     #endif
     #if __has_builtin(__builtin_memcpy)
       #define FPC_MEMCPY (void)__builtin_memcpy
@@ -273,6 +858,9 @@ FPC_ATTR void FPC_CALL fpc32_decode(
     #if __has_attribute(aligned)
       #define FPC_ALIGN(N) __attribute__((aligned(N)))
     #endif
+    #if __has_attribute(always_inline)
+      #define FPC_INLINE __inline__ __attribute__((always_inline))
+    #endif
   #endif
   #define FPC_RESTRICT __restrict__
 #elif defined(_MSC_VER)
@@ -286,6 +874,7 @@ FPC_ATTR void FPC_CALL fpc32_decode(
   #define FPC_BSWAP32 (uint32_t)_byteswap_ulong
   #define FPC_BSWAP64 (uint64_t)_byteswap_uint64
   #define FPC_ALIGN(N) __declspec(align(N))
+  #define FPC_INLINE __forceinline
   #define FPC_RESTRICT __restrict
   #define FPC_ASSUME __assume
 #endif
@@ -307,6 +896,10 @@ FPC_ATTR void FPC_CALL fpc32_decode(
   HASH = ((HASH << ctx->hash_args.dfcm_lshift) ^ \
   (size_t)((VALUE) >> ctx->hash_args.dfcm_rshift)) & dfcm_mod_mask
 
+// Leading zero byte count. The CLZ builtins are undefined for 0, which is the common case for well predicted values.
+#define FPC_LZBC64(VALUE) ((VALUE) != 0 ? (uint_fast8_t)(FPC_CLZ64((VALUE)) >> 3) : (uint_fast8_t)8)
+#define FPC_LZBC32(VALUE) ((VALUE) != 0 ? (uint_fast8_t)(FPC_CLZ32((VALUE)) >> 3) : (uint_fast8_t)4)
+
 #define FPC_IS_ALIGNED(PTR, ALIGN) \
   (((size_t)(PTR) & (size_t)((ALIGN) - 1)) == 0)
 
@@ -314,6 +907,10 @@ FPC_ATTR void FPC_CALL fpc32_decode(
   #include <string.h>
 #endif
 
+#ifndef FPC_INLINE
+  #define FPC_INLINE
+#endif
+
 #ifndef FPC_LIKELY_IF
   #define FPC_LIKELY_IF if
 #endif
@@ -334,6 +931,11 @@ FPC_ATTR void FPC_CALL fpc32_decode(
   #define FPC_MEMCPY_FIXED FPC_MEMCPY
 #endif
 
+#ifndef FPC_REALLOC
+  #include <stdlib.h>
+  #define FPC_REALLOC realloc
+#endif
+
 #ifndef FPC_MEMSET_FIXED
   #define FPC_MEMSET_FIXED FPC_MEMSET
 #endif
@@ -354,25 +956,408 @@ FPC_ATTR void FPC_CALL fpc32_decode(
   #define FPC_STORE_NT_U64(P, V) (*(uint64_t* FPC_RESTRICT)(P)) = (V)
 #endif
 
-#define FPC_IS_POW2(x) (((x) != 0) && (((x) & ((x) - 1)) != 0))
+#ifndef FPC_BSWAP32
+  #define FPC_BSWAP32(V) (uint32_t)( \
+    (((uint32_t)(V) & 0x000000FFU) << 24) | (((uint32_t)(V) & 0x0000FF00U) << 8) | \
+    (((uint32_t)(V) & 0x00FF0000U) >> 8) | (((uint32_t)(V) & 0xFF000000U) >> 24))
+#endif
 
-FPC_ATTR void FPC_CALL fpc_context_init(
-  fpc_context_ptr_t ctx,
-  uint64_t* FPC_RESTRICT fcm,
-  uint64_t* FPC_RESTRICT dfcm,
-  size_t fcm_size,
-  size_t dfcm_size,
-  fpc_hash_args_t hash_args,
-  double delta_seed)
-{
-  FPC_INVARIANT(FPC_IS_POW2(fcm_size));
-  FPC_INVARIANT(FPC_IS_POW2(dfcm_size));
-  ctx->fcm = fcm;
-  ctx->dfcm = dfcm;
-  ctx->fcm_size = fcm_size;
-  ctx->dfcm_size = dfcm_size;
-  ctx->hash_args = hash_args;
-  ctx->delta_seed = delta_seed;
+#ifndef FPC_BSWAP64
+  #define FPC_BSWAP64(V) (uint64_t)( \
+    ((uint64_t)FPC_BSWAP32((uint32_t)(V)) << 32) | (uint64_t)FPC_BSWAP32((uint32_t)((uint64_t)(V) >> 32)))
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+  #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #define FPC_HOST_BIG_ENDIAN
+  #endif
+#elif defined(__BIG_ENDIAN__)
+  #define FPC_HOST_BIG_ENDIAN
+#endif
+
+/*
+  Every multi-byte quantity in an FPC stream or checkpoint is stored in little-endian order.
+  Big-endian hosts byte-swap on the way in and out, unless FPC_SKIP_ENDIANNESS is defined,
+  in which case the stream uses the host byte order and is only portable between hosts of
+  the same endianness.
+*/
+#if defined(FPC_HOST_BIG_ENDIAN) && !defined(FPC_SKIP_ENDIANNESS)
+  #define FPC_SWAP_STREAM
+  #define FPC_LE64(V) FPC_BSWAP64(V)
+  #define FPC_LE32(V) FPC_BSWAP32(V)
+#else
+  #define FPC_LE64(V) (V)
+  #define FPC_LE32(V) (V)
+#endif
+
+#define FPC_CHECKPOINT_ZERO 15
+
+/*
+  Streaming output for calls larger than FPC_STREAMING_MIN_SIZE bytes. Output is staged in
+  a cache line sized buffer and written with non-temporal stores, so multi-gigabyte streams
+  do not evict the FCM and DFCM tables from the cache. Opt-in: define FPC_STREAMING to
+  enable it on SSE2 targets, and compare with fpc-bench first, since it only pays off when
+  other work competes for the cache.
+*/
+
+#if defined(FPC_STREAMING) && !(defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #undef FPC_STREAMING
+#endif
+
+#ifdef FPC_STREAMING
+  #ifdef __AVX__
+    #include <immintrin.h>
+  #else
+    #include <emmintrin.h>
+  #endif
+#endif
+
+#ifdef FPC_STREAMING
+
+#ifndef FPC_STREAMING_MIN_SIZE
+  #define FPC_STREAMING_MIN_SIZE ((size_t)1 << 25)
+#endif
+
+#ifndef FPC_PREFETCH_DISTANCE
+  #define FPC_PREFETCH_DISTANCE 64
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+  #define FPC_PREFETCH(P) __builtin_prefetch((const void*)(P), 0, 0)
+#else
+  #define FPC_PREFETCH(P) _mm_prefetch((const char*)(P), _MM_HINT_NTA)
+#endif
+
+#define FPC_CACHE_LINE_SIZE 64
+
+typedef struct fpc_stream_t
+{
+  // Staging area for the cache line starting at "line", plus room for one write of overflow.
+  // Callers keep their write position in a local cursor into "buffer".
+  uint8_t buffer[FPC_CACHE_LINE_SIZE * 2];
+  uint8_t* FPC_RESTRICT begin;
+  uint8_t* FPC_RESTRICT line;
+} fpc_stream_t;
+
+static uint8_t* fpc_stream_init(
+  fpc_stream_t* FPC_RESTRICT stream,
+  void* FPC_RESTRICT out)
+{
+  stream->begin = (uint8_t* FPC_RESTRICT)out;
+  stream->line = stream->begin - ((size_t)stream->begin & (FPC_CACHE_LINE_SIZE - 1));
+  return stream->buffer + (stream->begin - stream->line);
+}
+
+static uint8_t* fpc_stream_flush(
+  fpc_stream_t* FPC_RESTRICT stream,
+  uint8_t* FPC_RESTRICT cursor)
+{
+  size_t skip;
+  FPC_UNLIKELY_IF (stream->line < stream->begin)
+  {
+    // Only the tail of the first line belongs to the output.
+    skip = (size_t)(stream->begin - stream->line);
+    FPC_MEMCPY(stream->begin, stream->buffer + skip, FPC_CACHE_LINE_SIZE - skip);
+  }
+  else
+  {
+#ifdef __AVX__
+    _mm256_stream_si256((__m256i*)stream->line, _mm256_loadu_si256((const __m256i*)stream->buffer));
+    _mm256_stream_si256((__m256i*)stream->line + 1, _mm256_loadu_si256((const __m256i*)stream->buffer + 1));
+#else
+    _mm_stream_si128((__m128i*)stream->line, _mm_loadu_si128((const __m128i*)stream->buffer));
+    _mm_stream_si128((__m128i*)stream->line + 1, _mm_loadu_si128((const __m128i*)stream->buffer + 1));
+    _mm_stream_si128((__m128i*)stream->line + 2, _mm_loadu_si128((const __m128i*)stream->buffer + 2));
+    _mm_stream_si128((__m128i*)stream->line + 3, _mm_loadu_si128((const __m128i*)stream->buffer + 3));
+#endif
+  }
+  stream->line += FPC_CACHE_LINE_SIZE;
+  FPC_MEMCPY_FIXED(stream->buffer, stream->buffer + FPC_CACHE_LINE_SIZE, FPC_CACHE_LINE_SIZE);
+  return cursor - FPC_CACHE_LINE_SIZE;
+}
+
+// Appends the first "size" bytes of the "width" bytes at "data". "width" should be a constant.
+static FPC_INLINE uint8_t* fpc_stream_write(
+  fpc_stream_t* FPC_RESTRICT stream,
+  uint8_t* FPC_RESTRICT cursor,
+  const void* FPC_RESTRICT data,
+  size_t width,
+  size_t size)
+{
+  FPC_INVARIANT(size <= width && width <= FPC_CACHE_LINE_SIZE);
+  FPC_MEMCPY_FIXED(cursor, data, width);
+  cursor += size;
+  FPC_UNLIKELY_IF (cursor >= stream->buffer + FPC_CACHE_LINE_SIZE)
+    cursor = fpc_stream_flush(stream, cursor);
+  return cursor;
+}
+
+static void fpc_stream_finish(
+  fpc_stream_t* FPC_RESTRICT stream,
+  uint8_t* FPC_RESTRICT cursor)
+{
+  size_t skip;
+  skip = stream->line < stream->begin ? (size_t)(stream->begin - stream->line) : 0;
+  FPC_MEMCPY(stream->line + skip, stream->buffer + skip, (size_t)(cursor - stream->buffer) - skip);
+  _mm_sfence();
+}
+
+#endif
+
+#define FPC_REF_FCM 0
+#define FPC_REF_DFCM 1
+#define FPC_REF_SNAPSHOT 2
+#define FPC_REF_SNAPSHOT_DELTA 3
+
+#define FPC_GRID_FCM 0
+#define FPC_GRID_DFCM 1
+#define FPC_GRID_LORENZO 2
+
+#define FPC_GRID_INF64 ((uint64_t)0x7FF0 << 48)
+#define FPC_GRID_NAN64 ((uint64_t)0x7FF8 << 48)
+#define FPC_GRID_INF32 0x7F800000U
+#define FPC_GRID_NAN32 0x7FC00000U
+
+/*
+  The Lorenzo predictor must round the same way when encoding and decoding, possibly on
+  another machine. Targets that evaluate in a wider format, such as x87, round every step
+  through memory. Builds that reassociate floating-point math (-ffast-math) or flush
+  subnormals do not produce portable grid streams.
+*/
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  #define FPC_GRID_ROUND64(V) (V)
+  #define FPC_GRID_ROUND32(V) (V)
+#else
+static double fpc_grid_round64(
+  double value)
+{
+  volatile double rounded = value;
+  return rounded;
+}
+
+static float fpc_grid_round32(
+  float value)
+{
+  volatile float rounded = value;
+  return rounded;
+}
+
+#define FPC_GRID_ROUND64(V) fpc_grid_round64((V))
+#define FPC_GRID_ROUND32(V) fpc_grid_round32((V))
+#endif
+
+#ifndef FPC_BLOCK_MIN_GAIN_SHIFT
+  #define FPC_BLOCK_MIN_GAIN_SHIFT 4
+#endif
+
+#ifndef FPC_FAST_SAMPLE_COUNT
+  #define FPC_FAST_SAMPLE_COUNT 32
+#endif
+
+// Adaptive blocks: blocks between regime changes, and the weight of the running average
+// block size, as a shift.
+#ifndef FPC_ADAPTIVE_MIN_BLOCKS
+  #define FPC_ADAPTIVE_MIN_BLOCKS 16
+#endif
+
+#define FPC_ADAPTIVE_AVERAGE_SHIFT 3
+
+// A block jumped if it is over 1.5 times the running average, plus some slack.
+#define FPC_ADAPTIVE_JUMPED(SIZE, AVERAGE, RAW_SIZE) \
+  ((SIZE) > (AVERAGE) + (AVERAGE) / 2 + ((RAW_SIZE) >> FPC_BLOCK_MIN_GAIN_SHIFT))
+
+// Values encoded per buffer growth step. Must be even, so header bytes never straddle two steps.
+#define FPC_BUFFER_STEP_COUNT 4096
+
+static FPC_BOOL fpc_buffer_reserve(
+  fpc_buffer_t* FPC_RESTRICT buffer,
+  size_t size)
+{
+  size_t capacity;
+  void* data;
+  if (size <= buffer->capacity)
+    return 1;
+  capacity = buffer->capacity + buffer->capacity / 2;
+  if (capacity < size)
+    capacity = size;
+  if (buffer->realloc_fn != NULL)
+    data = buffer->realloc_fn(buffer->user_data, buffer->data, capacity);
+  else
+    data = FPC_REALLOC(buffer->data, capacity);
+  if (data == NULL)
+    return 0;
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 1;
+}
+
+#ifndef FPC_NO_ALLOCATOR
+
+#ifndef FPC_FREE
+  #include <stdlib.h>
+  #define FPC_FREE free
+#endif
+
+#ifdef __linux__
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+  #ifdef MAP_ANONYMOUS
+    #define FPC_MMAP_TABLES
+  #endif
+#endif
+
+#ifndef FPC_HUGE_PAGE_SIZE
+  #define FPC_HUGE_PAGE_SIZE ((size_t)1 << 21)
+#endif
+
+// MPOL_PREFERRED from <linux/mempolicy.h>, which is not always installed.
+#define FPC_MPOL_PREFERRED 1
+
+#if defined(__clang__) || defined(__GNUC__)
+  #define FPC_SPIN_TRY_LOCK(LOCK) (__atomic_exchange_n((LOCK), 1, __ATOMIC_ACQUIRE) == 0)
+  #define FPC_SPIN_IS_LOCKED(LOCK) (__atomic_load_n((LOCK), __ATOMIC_RELAXED) != 0)
+  #define FPC_SPIN_UNLOCK(LOCK) __atomic_store_n((LOCK), 0, __ATOMIC_RELEASE)
+  #if defined(__has_builtin) && (defined(__i386__) || defined(__x86_64__))
+    #if __has_builtin(__builtin_ia32_pause)
+      #define FPC_SPIN_PAUSE() __builtin_ia32_pause()
+    #endif
+  #endif
+#elif defined(_MSC_VER)
+  #define FPC_SPIN_TRY_LOCK(LOCK) (_InterlockedExchange((LOCK), 1) == 0)
+  #define FPC_SPIN_IS_LOCKED(LOCK) (*(LOCK) != 0)
+  #define FPC_SPIN_UNLOCK(LOCK) (void)_InterlockedExchange((LOCK), 0)
+  #if defined(_M_IX86) || defined(_M_X64)
+    #define FPC_SPIN_PAUSE() _mm_pause()
+  #endif
+#else
+  // No atomics available: pools are only safe to use from a single thread.
+  #define FPC_SPIN_TRY_LOCK(LOCK) ((*(LOCK) = 1) != 0)
+  #define FPC_SPIN_IS_LOCKED(LOCK) 0
+  #define FPC_SPIN_UNLOCK(LOCK) (void)(*(LOCK) = 0)
+#endif
+
+#ifndef FPC_SPIN_PAUSE
+  #define FPC_SPIN_PAUSE()
+#endif
+
+/*
+  Table allocation. On Linux, tables of at least FPC_HUGE_PAGE_SIZE bytes are mapped with
+  MAP_HUGETLB, or with transparent huge pages when no huge pages are reserved, so random
+  lookups do not miss the TLB on every access. Each mapping is bound to the NUMA node of
+  the thread that allocates it, as preferred placement, when the table is created. Smaller
+  tables, other systems, and builds where <sys/mman.h> hides MAP_ANONYMOUS (strict C modes
+  without _DEFAULT_SOURCE), use FPC_REALLOC. Tables start zeroed.
+*/
+
+#ifdef FPC_MMAP_TABLES
+static void fpc_table_bind(
+  void* table,
+  size_t size)
+{
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+  unsigned cpu, node;
+  unsigned long node_mask;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= sizeof(node_mask) * 8 - 1)
+    return;
+  node_mask = 1UL << node;
+  (void)syscall(SYS_mbind, table, size, FPC_MPOL_PREFERRED, &node_mask, (unsigned long)(sizeof(node_mask) * 8), 0U);
+#else
+  (void)table;
+  (void)size;
+#endif
+}
+#endif
+
+static void* fpc_table_alloc(
+  size_t size)
+{
+  void* table;
+#ifdef FPC_MMAP_TABLES
+  if (size >= FPC_HUGE_PAGE_SIZE)
+  {
+    size = (size + FPC_HUGE_PAGE_SIZE - 1) & ~(FPC_HUGE_PAGE_SIZE - 1);
+    table = MAP_FAILED;
+  #ifdef MAP_HUGETLB
+    table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  #endif
+    if (table == MAP_FAILED)
+    {
+      table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (table == MAP_FAILED)
+        return NULL;
+    #ifdef MADV_HUGEPAGE
+      (void)madvise(table, size, MADV_HUGEPAGE);
+    #endif
+    }
+    fpc_table_bind(table, size);
+    return table;
+  }
+#endif
+  table = FPC_REALLOC(NULL, size);
+  if (table != NULL)
+    FPC_MEMSET(table, 0, size);
+  return table;
+}
+
+static void fpc_table_free(
+  void* table,
+  size_t size)
+{
+  if (table == NULL)
+    return;
+#ifdef FPC_MMAP_TABLES
+  if (size >= FPC_HUGE_PAGE_SIZE)
+  {
+    (void)munmap(table, (size + FPC_HUGE_PAGE_SIZE - 1) & ~(FPC_HUGE_PAGE_SIZE - 1));
+    return;
+  }
+#else
+  (void)size;
+#endif
+  FPC_FREE(table);
+}
+
+static void fpc_spin_lock(
+  volatile long* lock)
+{
+  while (!FPC_SPIN_TRY_LOCK(lock))
+  {
+    while (FPC_SPIN_IS_LOCKED(lock))
+      FPC_SPIN_PAUSE();
+  }
+}
+
+#endif
+
+#define FPC_IS_POW2(x) (((x) != 0) && (((x) & ((x) - 1)) == 0))
+
+static void fpc_context_reset_state(
+  fpc_context_ptr_t ctx)
+{
+  ctx->fcm_hash = ctx->dfcm_hash = 0;
+  ctx->fcm_prediction = ctx->dfcm_prediction = 0;
+  FPC_MEMCPY(&ctx->last, &ctx->delta_seed, sizeof(uint64_t));
+}
+
+FPC_ATTR void FPC_CALL fpc_context_init(
+  fpc_context_ptr_t ctx,
+  uint64_t* FPC_RESTRICT fcm,
+  uint64_t* FPC_RESTRICT dfcm,
+  size_t fcm_size,
+  size_t dfcm_size,
+  fpc_hash_args_t hash_args,
+  double delta_seed)
+{
+  FPC_INVARIANT(FPC_IS_POW2(fcm_size));
+  FPC_INVARIANT(FPC_IS_POW2(dfcm_size));
+  ctx->fcm = fcm;
+  ctx->dfcm = dfcm;
+  ctx->fcm_size = fcm_size;
+  ctx->dfcm_size = dfcm_size;
+  ctx->hash_args = hash_args;
+  ctx->delta_seed = delta_seed;
+  fpc_context_reset_state(ctx);
 }
 
 FPC_ATTR void FPC_CALL fpc_context_init_default(
@@ -391,6 +1376,307 @@ FPC_ATTR void FPC_CALL fpc_context_reset(
 {
   FPC_MEMSET(ctx->fcm, 0, ctx->fcm_size * sizeof(uint64_t));
   FPC_MEMSET(ctx->dfcm, 0, ctx->dfcm_size * sizeof(uint64_t));
+  fpc_context_reset_state(ctx);
+}
+
+#ifndef FPC_NO_ALLOCATOR
+
+// Contexts handed out by fpc_context_create. The link is used by context pools.
+typedef struct fpc_context_node_t
+{
+  fpc_context_t ctx;
+  struct fpc_context_node_t* next;
+} fpc_context_node_t;
+
+FPC_ATTR fpc_context_t* FPC_CALL fpc_context_create(
+  size_t fcm_size,
+  size_t dfcm_size)
+{
+  fpc_context_node_t* node;
+  uint64_t* fcm;
+  uint64_t* dfcm;
+  node = (fpc_context_node_t*)FPC_REALLOC(NULL, sizeof(fpc_context_node_t));
+  fcm = (uint64_t*)fpc_table_alloc(fcm_size * sizeof(uint64_t));
+  dfcm = (uint64_t*)fpc_table_alloc(dfcm_size * sizeof(uint64_t));
+  if (node == NULL || fcm == NULL || dfcm == NULL)
+  {
+    fpc_table_free(fcm, fcm_size * sizeof(uint64_t));
+    fpc_table_free(dfcm, dfcm_size * sizeof(uint64_t));
+    FPC_FREE(node);
+    return NULL;
+  }
+  fpc_context_init_default(&node->ctx, fcm, dfcm, fcm_size, dfcm_size);
+  fpc_context_reset_state(&node->ctx);
+  node->next = NULL;
+  return &node->ctx;
+}
+
+FPC_ATTR void FPC_CALL fpc_context_destroy(
+  fpc_context_t* ctx)
+{
+  if (ctx == NULL)
+    return;
+  fpc_table_free(ctx->fcm, ctx->fcm_size * sizeof(uint64_t));
+  fpc_table_free(ctx->dfcm, ctx->dfcm_size * sizeof(uint64_t));
+  FPC_FREE((fpc_context_node_t*)ctx);
+}
+
+FPC_ATTR void FPC_CALL fpc_context_pool_init(
+  fpc_context_pool_t* pool,
+  size_t fcm_size,
+  size_t dfcm_size)
+{
+  FPC_INVARIANT(FPC_IS_POW2(fcm_size));
+  FPC_INVARIANT(FPC_IS_POW2(dfcm_size));
+  pool->fcm_size = fcm_size;
+  pool->dfcm_size = dfcm_size;
+  pool->free_list = NULL;
+  pool->lock = 0;
+}
+
+FPC_ATTR fpc_context_t* FPC_CALL fpc_context_pool_acquire(
+  fpc_context_pool_t* pool,
+  uint32_t flags)
+{
+  fpc_context_node_t* node;
+  fpc_spin_lock(&pool->lock);
+  node = (fpc_context_node_t*)pool->free_list;
+  if (node != NULL)
+    pool->free_list = node->next;
+  FPC_SPIN_UNLOCK(&pool->lock);
+  if (node == NULL)
+    return fpc_context_create(pool->fcm_size, pool->dfcm_size);
+  if ((flags & FPC_POOL_RESET) != 0)
+    fpc_context_reset(&node->ctx);
+  return &node->ctx;
+}
+
+FPC_ATTR void FPC_CALL fpc_context_pool_release(
+  fpc_context_pool_t* pool,
+  fpc_context_t* ctx)
+{
+  fpc_context_node_t* node = (fpc_context_node_t*)ctx;
+  FPC_INVARIANT(ctx->fcm_size == pool->fcm_size && ctx->dfcm_size == pool->dfcm_size);
+  fpc_spin_lock(&pool->lock);
+  node->next = (fpc_context_node_t*)pool->free_list;
+  pool->free_list = node;
+  FPC_SPIN_UNLOCK(&pool->lock);
+}
+
+FPC_ATTR void FPC_CALL fpc_context_pool_destroy(
+  fpc_context_pool_t* pool)
+{
+  fpc_context_node_t* node;
+  fpc_context_node_t* next;
+  for (node = (fpc_context_node_t*)pool->free_list; node != NULL; node = next)
+  {
+    next = node->next;
+    fpc_context_destroy(&node->ctx);
+  }
+  pool->free_list = NULL;
+}
+
+#endif
+
+/*
+  Packed checkpoint tables: one header byte per pair of entries, each nibble holding the
+  number of bytes of "entry ^ previous nonzero entry" that follow, or FPC_CHECKPOINT_ZERO.
+  Unpacking stops with NULL on any other nibble or at "in_end", and only checks the input
+  when "table" is NULL.
+*/
+
+static void fpc_copy_le(
+  void* FPC_RESTRICT out,
+  const void* FPC_RESTRICT in,
+  size_t count)
+{
+#ifdef FPC_SWAP_STREAM
+  uint64_t value;
+  size_t i;
+  for (i = 0; i != count; ++i)
+  {
+    FPC_MEMCPY(&value, (const uint8_t* FPC_RESTRICT)in + i * sizeof(uint64_t), sizeof(uint64_t));
+    value = FPC_BSWAP64(value);
+    FPC_MEMCPY((uint8_t* FPC_RESTRICT)out + i * sizeof(uint64_t), &value, sizeof(uint64_t));
+  }
+#else
+  FPC_MEMCPY(out, in, count * sizeof(uint64_t));
+#endif
+}
+
+static uint8_t* fpc_checkpoint_pack(
+  const uint64_t* FPC_RESTRICT table,
+  size_t size,
+  uint8_t* FPC_RESTRICT out)
+{
+  uint8_t* FPC_RESTRICT out_h;
+  const uint64_t* FPC_RESTRICT const end = table + size;
+  uint64_t value, value_xor, base;
+  uint_fast8_t header, length, i;
+  base = 0;
+  while (table != end)
+  {
+    out_h = out;
+    ++out;
+    header = 0;
+    for (i = 0; i != 2 && table != end; ++i)
+    {
+      value = *table;
+      ++table;
+      if (value == 0)
+      {
+        header |= FPC_CHECKPOINT_ZERO << (i << 2);
+        continue;
+      }
+      value_xor = value ^ base;
+      base = value;
+      length = 8 - FPC_LZBC64(value_xor);
+      FPC_INVARIANT(length <= 8);
+      value_xor = FPC_LE64(value_xor);
+      FPC_MEMCPY(out, &value_xor, length);
+      out += length;
+      header |= length << (i << 2);
+    }
+    *out_h = header;
+  }
+  return out;
+}
+
+static const uint8_t* fpc_checkpoint_unpack(
+  uint64_t* FPC_RESTRICT table,
+  size_t size,
+  const uint8_t* FPC_RESTRICT in,
+  const uint8_t* FPC_RESTRICT in_end)
+{
+  uint64_t value, base;
+  size_t j;
+  uint_fast8_t header, length, i;
+  base = 0;
+  for (j = 0; j != size;)
+  {
+    if (in == in_end)
+      return NULL;
+    header = *in;
+    ++in;
+    for (i = 0; i != 2 && j != size; ++i, ++j)
+    {
+      length = header & 15;
+      header >>= 4;
+      value = 0;
+      if (length != FPC_CHECKPOINT_ZERO)
+      {
+        if (length > sizeof(value) || (size_t)(in_end - in) < length)
+          return NULL;
+        FPC_MEMCPY(&value, in, length);
+        in += length;
+        value = FPC_LE64(value);
+        value ^= base;
+        base = value;
+      }
+      if (table != NULL)
+        table[j] = value;
+    }
+  }
+  return in;
+}
+
+FPC_ATTR size_t FPC_CALL fpc_context_save(
+  fpc_context_ptr_t ctx,
+  uint32_t flags,
+  void* FPC_RESTRICT out)
+{
+  uint8_t* FPC_RESTRICT out_b;
+  uint64_t state[5];
+  out_b = (uint8_t* FPC_RESTRICT)out;
+  out_b[0] = FPC_CHECKPOINT_VERSION;
+  out_b[1] = (uint8_t)(flags & FPC_CHECKPOINT_COMPRESS);
+  out_b[2] = (uint8_t)FPC_CTZ64((uint64_t)ctx->fcm_size);
+  out_b[3] = (uint8_t)FPC_CTZ64((uint64_t)ctx->dfcm_size);
+  out_b[4] = ctx->hash_args.fcm_lshift;
+  out_b[5] = ctx->hash_args.fcm_rshift;
+  out_b[6] = ctx->hash_args.dfcm_lshift;
+  out_b[7] = ctx->hash_args.dfcm_rshift;
+  state[0] = FPC_LE64(ctx->fcm_hash);
+  state[1] = FPC_LE64(ctx->dfcm_hash);
+  state[2] = FPC_LE64(ctx->fcm_prediction);
+  state[3] = FPC_LE64(ctx->dfcm_prediction);
+  state[4] = FPC_LE64(ctx->last);
+  FPC_MEMCPY(out_b + 8, state, sizeof(state));
+  out_b += 48;
+  if (flags & FPC_CHECKPOINT_COMPRESS)
+  {
+    out_b = fpc_checkpoint_pack(ctx->fcm, ctx->fcm_size, out_b);
+    out_b = fpc_checkpoint_pack(ctx->dfcm, ctx->dfcm_size, out_b);
+  }
+  else
+  {
+    fpc_copy_le(out_b, ctx->fcm, ctx->fcm_size);
+    out_b += ctx->fcm_size * sizeof(uint64_t);
+    fpc_copy_le(out_b, ctx->dfcm, ctx->dfcm_size);
+    out_b += ctx->dfcm_size * sizeof(uint64_t);
+  }
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_context_load(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  size_t in_size)
+{
+  const uint8_t* FPC_RESTRICT in_b;
+  const uint8_t* FPC_RESTRICT in_end;
+  const uint8_t* FPC_RESTRICT tables;
+  const uint8_t* FPC_RESTRICT end;
+  uint64_t state[5];
+  in_b = (const uint8_t* FPC_RESTRICT)in;
+  in_end = in_b + in_size;
+  if (in_size < 48 ||
+    in_b[0] != FPC_CHECKPOINT_VERSION ||
+    in_b[2] >= sizeof(size_t) * 8 || ((size_t)1 << in_b[2]) != ctx->fcm_size ||
+    in_b[3] >= sizeof(size_t) * 8 || ((size_t)1 << in_b[3]) != ctx->dfcm_size ||
+    in_b[4] >= sizeof(size_t) * 8 || in_b[5] >= 64 ||
+    in_b[6] >= sizeof(size_t) * 8 || in_b[7] >= 64)
+    return 0;
+  FPC_MEMCPY(state, in_b + 8, sizeof(state));
+  // The hashes index the tables before they are masked again.
+  if (FPC_LE64(state[0]) >= ctx->fcm_size || FPC_LE64(state[1]) >= ctx->dfcm_size)
+    return 0;
+  tables = in_b + 48;
+  // Find the end of the tables before anything in "ctx" is overwritten.
+  if (in_b[1] & FPC_CHECKPOINT_COMPRESS)
+  {
+    end = fpc_checkpoint_unpack(NULL, ctx->fcm_size, tables, in_end);
+    if (end != NULL)
+      end = fpc_checkpoint_unpack(NULL, ctx->dfcm_size, end, in_end);
+    if (end == NULL)
+      return 0;
+  }
+  else
+  {
+    if ((size_t)(in_end - tables) / sizeof(uint64_t) < ctx->fcm_size + ctx->dfcm_size)
+      return 0;
+    end = tables + (ctx->fcm_size + ctx->dfcm_size) * sizeof(uint64_t);
+  }
+  ctx->hash_args.fcm_lshift = in_b[4];
+  ctx->hash_args.fcm_rshift = in_b[5];
+  ctx->hash_args.dfcm_lshift = in_b[6];
+  ctx->hash_args.dfcm_rshift = in_b[7];
+  ctx->fcm_hash = FPC_LE64(state[0]);
+  ctx->dfcm_hash = FPC_LE64(state[1]);
+  ctx->fcm_prediction = FPC_LE64(state[2]);
+  ctx->dfcm_prediction = FPC_LE64(state[3]);
+  ctx->last = FPC_LE64(state[4]);
+  if (in_b[1] & FPC_CHECKPOINT_COMPRESS)
+  {
+    tables = fpc_checkpoint_unpack(ctx->fcm, ctx->fcm_size, tables, end);
+    (void)fpc_checkpoint_unpack(ctx->dfcm, ctx->dfcm_size, tables, end);
+  }
+  else
+  {
+    fpc_copy_le(ctx->fcm, tables, ctx->fcm_size);
+    fpc_copy_le(ctx->dfcm, tables + ctx->fcm_size * sizeof(uint64_t), ctx->dfcm_size);
+  }
+  return (size_t)(end - in_b);
 }
 
 FPC_ATTR size_t FPC_CALL fpc_encode_size(
@@ -412,8 +1698,11 @@ FPC_ATTR size_t FPC_CALL fpc_encode_size(
   size = 0;
   if (in == end)
     return size;
-  last = *(const uint64_t* FPC_RESTRICT)&ctx->delta_seed;
-  fcm_hash = dfcm_hash = fcm_prediction = dfcm_prediction = 0;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
   do
   {
     #ifdef __clang__
@@ -429,13 +1718,11 @@ FPC_ATTR size_t FPC_CALL fpc_encode_size(
       dfcm_xor = value ^ dfcm_prediction;
       type = fcm_xor > dfcm_xor;
       value_xor = type ? dfcm_xor : fcm_xor;
-      lzbc = FPC_CLZ64(value_xor) >> 3;
+      lzbc = FPC_LZBC64(value_xor);
       lzbc -= (lzbc == FPC_LEAST_FREQUENT_LZBC);
       lzbc = 8 - lzbc;
       FPC_INVARIANT(lzbc <= 8);
       size += lzbc;
-      FPC_UNLIKELY_IF (in == end)
-        break;
       delta = value - last;
       last = value;
       ctx->fcm[fcm_hash] = value;
@@ -445,13 +1732,21 @@ FPC_ATTR size_t FPC_CALL fpc_encode_size(
       FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
       dfcm_prediction = ctx->dfcm[dfcm_hash];
       dfcm_prediction += value;
+      FPC_UNLIKELY_IF (in == end)
+        break;
     }
     ++size;
   } while (in != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
   return size;
 }
 
-FPC_ATTR size_t FPC_CALL fpc_encode_separate(
+#ifdef FPC_STREAMING
+static size_t fpc_encode_separate_streaming(
   fpc_context_ptr_t ctx,
   const double* FPC_RESTRICT in,
   size_t count,
@@ -461,9 +1756,11 @@ FPC_ATTR size_t FPC_CALL fpc_encode_separate(
   const size_t fcm_mod_mask = ctx->fcm_size - 1;
   const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
   const double* FPC_RESTRICT const end = in + count;
-  uint8_t* FPC_RESTRICT out_begin;
-  uint8_t* FPC_RESTRICT out_b;
-  uint8_t* FPC_RESTRICT out_h;
+  fpc_stream_t header_stream, data_stream;
+  uint8_t* FPC_RESTRICT header_cursor;
+  uint8_t* FPC_RESTRICT data_cursor;
+  size_t size;
+  uint8_t header_byte;
   uint64_t
     value, value_xor,
     fcm_hash, dfcm_hash,
@@ -479,13 +1776,18 @@ FPC_ATTR size_t FPC_CALL fpc_encode_separate(
     (uint8_t* FPC_RESTRICT)out_headers + count >= (uint8_t* FPC_RESTRICT)out_data);
   if (in == end)
     return 0;
-  out_h = (uint8_t * FPC_RESTRICT)out_headers;
-  out_begin = out_b = (uint8_t* FPC_RESTRICT)out_data;
-  last = *(const uint64_t* FPC_RESTRICT)&ctx->delta_seed;
-  fcm_hash = dfcm_hash = fcm_prediction = dfcm_prediction = 0;
+  header_cursor = fpc_stream_init(&header_stream, out_headers);
+  data_cursor = fpc_stream_init(&data_stream, out_data);
+  size = 0;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
   do
   {
     header = 0;
+    FPC_PREFETCH(in + FPC_PREFETCH_DISTANCE);
     #ifdef __clang__
       #pragma clang unroll(full)
     #elif defined(__GNUC__)
@@ -499,15 +1801,14 @@ FPC_ATTR size_t FPC_CALL fpc_encode_separate(
       dfcm_xor = value ^ dfcm_prediction;
       type = fcm_xor > dfcm_xor;
       value_xor = type ? dfcm_xor : fcm_xor;
-      lzbc = FPC_CLZ64(value_xor) >> 3;
+      lzbc = FPC_LZBC64(value_xor);
       header |= (((type << 3) | (lzbc - (lzbc >= FPC_LEAST_FREQUENT_LZBC)))) << (i << 2);
       lzbc -= (lzbc == FPC_LEAST_FREQUENT_LZBC);
       lzbc = 8 - lzbc;
       FPC_INVARIANT(lzbc <= 8);
-      FPC_MEMCPY(out_b, &value_xor, lzbc);
-      out_b += lzbc;
-      FPC_UNLIKELY_IF (in == end)
-        break;
+      value_xor = FPC_LE64(value_xor);
+      data_cursor = fpc_stream_write(&data_stream, data_cursor, &value_xor, sizeof(value_xor), lzbc);
+      size += lzbc;
       delta = value - last;
       last = value;
       ctx->fcm[fcm_hash] = value;
@@ -517,164 +1818,65 @@ FPC_ATTR size_t FPC_CALL fpc_encode_separate(
       FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
       dfcm_prediction = ctx->dfcm[dfcm_hash];
       dfcm_prediction += value;
+      FPC_UNLIKELY_IF (in == end)
+        break;
     }
-    *out_h = header;
-    ++out_h;
+    header_byte = (uint8_t)header;
+    header_cursor = fpc_stream_write(&header_stream, header_cursor, &header_byte, 1, 1);
   } while (in != end);
-  return (size_t)(out_b - out_begin) + (count + 1) / 2;
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  fpc_stream_finish(&header_stream, header_cursor);
+  fpc_stream_finish(&data_stream, data_cursor);
+  return size + (count + 1) / 2;
 }
+#endif
 
-FPC_ATTR void FPC_CALL fpc_decode_separate(
-  fpc_context_ptr_t ctx,
-  const void* FPC_RESTRICT headers,
-  const void* FPC_RESTRICT in,
-  double* FPC_RESTRICT out,
-  size_t out_count)
-{
-  double* FPC_RESTRICT const end = out + out_count;
-  const size_t fcm_mod_mask = ctx->fcm_size - 1;
-  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
-  const uint8_t* FPC_RESTRICT in_data;
-  const uint8_t* FPC_RESTRICT in_h;
-  uint64_t
-    fcm_hash, dfcm_hash,
-    fcm_prediction, dfcm_prediction,
-    delta, last,
-    value;
-  uint_fast8_t
-    type, lzbc,
-    header, i;
-  if (out == end)
-    return;
-  in_data = (const uint8_t* FPC_RESTRICT)in;
-  in_h = (const uint8_t* FPC_RESTRICT)headers;
-  last = *(const uint64_t* FPC_RESTRICT)&ctx->delta_seed;
-  fcm_hash = dfcm_hash = fcm_prediction = dfcm_prediction = 0;
-  do
-  {
-    header = *in_h;
-    ++in_h;
-    #ifdef __clang__
-      #pragma clang unroll(full)
-    #elif defined(__GNUC__)
-      #pragma GCC unroll(2)
-    #endif
-    for (i = 0; i != 2; ++i)
-    {
-      type = header & 8;
-      lzbc = (header & 7);
-      lzbc += (lzbc >= FPC_LEAST_FREQUENT_LZBC);
-      lzbc = 8 - lzbc;
-      header >>= 4;
-      value = 0;
-      FPC_MEMCPY(&value, in_data, lzbc);
-      value ^= type ? dfcm_prediction : fcm_prediction;
-      FPC_STORE_NT_U64(out, value);
-      ++out;
-      FPC_UNLIKELY_IF (out == end)
-        return;
-      in_data += lzbc;
-      delta = value - last;
-      last = value;
-      ctx->fcm[fcm_hash] = value;
-      FPC_FCM_HASH_UPDATE(fcm_hash, value);
-      fcm_prediction = ctx->fcm[fcm_hash];
-      ctx->dfcm[dfcm_hash] = delta;
-      FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
-      dfcm_prediction = ctx->dfcm[dfcm_hash];
-      dfcm_prediction += value;
-    }
-  } while (out != end);
-}
-
-FPC_ATTR size_t FPC_CALL fpc_encode(
+FPC_ATTR size_t FPC_CALL fpc_encode_separate(
   fpc_context_ptr_t ctx,
   const double* FPC_RESTRICT in,
   size_t count,
-  void* FPC_RESTRICT out)
-{
-  return fpc_encode_separate(
-    ctx,
-    in,
-    count,
-    out,
-    (uint8_t* FPC_RESTRICT)out + FPC_UPPER_BOUND_METADATA(count));
-}
-
-FPC_ATTR void FPC_CALL fpc_decode(
-  fpc_context_ptr_t ctx,
-  const void* FPC_RESTRICT in,
-  double* FPC_RESTRICT out,
-  size_t out_count)
-{
-  fpc_decode_separate(
-    ctx,
-    in,
-    (const uint8_t* FPC_RESTRICT)in + FPC_UPPER_BOUND_METADATA(out_count),
-    out,
-    out_count);
-}
-
-FPC_ATTR void FPC_CALL fpc32_context_init(
-  fpc32_context_ptr_t ctx,
-  uint32_t* FPC_RESTRICT fcm,
-  uint32_t* FPC_RESTRICT dfcm,
-  size_t fcm_size,
-  size_t dfcm_size,
-  fpc_hash_args_t hash_args,
-  float delta_seed)
-{
-  FPC_INVARIANT(FPC_IS_POW2(fcm_size));
-  FPC_INVARIANT(FPC_IS_POW2(dfcm_size));
-  ctx->fcm = fcm;
-  ctx->dfcm = dfcm;
-  ctx->fcm_size = fcm_size;
-  ctx->dfcm_size = dfcm_size;
-  ctx->hash_args = hash_args;
-  ctx->delta_seed = delta_seed;
-}
-
-FPC_ATTR void FPC_CALL fpc32_context_init_default(
-  fpc32_context_ptr_t ctx,
-  uint32_t* FPC_RESTRICT fcm,
-  uint32_t* FPC_RESTRICT dfcm,
-  size_t fcm_size,
-  size_t dfcm_size)
-{
-  const fpc_hash_args_t hash_args = FPC32_DEFAULT_HASH_ARGS;
-  fpc32_context_init(ctx, fcm, dfcm, fcm_size, dfcm_size, hash_args, 0.0F);
-}
-
-FPC_ATTR void FPC_CALL fpc32_context_reset(
-  fpc32_context_ptr_t ctx)
-{
-  FPC_MEMSET(ctx->fcm, 0, ctx->fcm_size * sizeof(uint32_t));
-  FPC_MEMSET(ctx->dfcm, 0, ctx->dfcm_size * sizeof(uint32_t));
-}
-
-FPC_ATTR size_t FPC_CALL fpc32_encode_size(
-  fpc32_context_ptr_t ctx,
-  const float* FPC_RESTRICT in,
-  size_t count)
+  void* FPC_RESTRICT out_headers,
+  void* FPC_RESTRICT out_data)
 {
   const size_t fcm_mod_mask = ctx->fcm_size - 1;
   const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
-  const float* FPC_RESTRICT const end = in + count;
-  size_t size;
-  uint32_t
+  const double* FPC_RESTRICT const end = in + count;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint8_t* FPC_RESTRICT out_h;
+  uint64_t
     value, value_xor,
     fcm_hash, dfcm_hash,
     fcm_prediction, dfcm_prediction,
     delta, last,
     fcm_xor, dfcm_xor;
-  uint_fast8_t type, lzbc, i;
-  size = 0;
+  uint_fast8_t
+    type, lzbc,
+    header, i;
+#ifdef FPC_STREAMING
+  if (count >= FPC_STREAMING_MIN_SIZE / sizeof(uint64_t))
+    return fpc_encode_separate_streaming(ctx, in, count, out_headers, out_data);
+#endif
+  FPC_INVARIANT((uint8_t* FPC_RESTRICT)out_headers != (uint8_t* FPC_RESTRICT)out_data);
+  FPC_INVARIANT(
+    (uint8_t* FPC_RESTRICT)out_headers < (uint8_t* FPC_RESTRICT)out_data ||
+    (uint8_t* FPC_RESTRICT)out_headers + count >= (uint8_t* FPC_RESTRICT)out_data);
   if (in == end)
-    return size;
-  last = *(const uint32_t* FPC_RESTRICT)&ctx->delta_seed;
-  fcm_hash = dfcm_hash = fcm_prediction = dfcm_prediction = 0;
+    return 0;
+  out_h = (uint8_t * FPC_RESTRICT)out_headers;
+  out_begin = out_b = (uint8_t* FPC_RESTRICT)out_data;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
   do
   {
+    header = 0;
     #ifdef __clang__
       #pragma clang unroll(full)
     #elif defined(__GNUC__)
@@ -688,12 +1890,14 @@ FPC_ATTR size_t FPC_CALL fpc32_encode_size(
       dfcm_xor = value ^ dfcm_prediction;
       type = fcm_xor > dfcm_xor;
       value_xor = type ? dfcm_xor : fcm_xor;
-      lzbc = FPC_CLZ32(value_xor) >> 3;
-      lzbc = 4 - lzbc;
-      FPC_INVARIANT(lzbc <= 4);
-      size += lzbc;
-      FPC_UNLIKELY_IF (in == end)
-        break;
+      lzbc = FPC_LZBC64(value_xor);
+      header |= (((type << 3) | (lzbc - (lzbc >= FPC_LEAST_FREQUENT_LZBC)))) << (i << 2);
+      lzbc -= (lzbc == FPC_LEAST_FREQUENT_LZBC);
+      lzbc = 8 - lzbc;
+      FPC_INVARIANT(lzbc <= 8);
+      value_xor = FPC_LE64(value_xor);
+      FPC_MEMCPY(out_b, &value_xor, lzbc);
+      out_b += lzbc;
       delta = value - last;
       last = value;
       ctx->fcm[fcm_hash] = value;
@@ -703,47 +1907,58 @@ FPC_ATTR size_t FPC_CALL fpc32_encode_size(
       FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
       dfcm_prediction = ctx->dfcm[dfcm_hash];
       dfcm_prediction += value;
+      FPC_UNLIKELY_IF (in == end)
+        break;
     }
-    ++size;
+    *out_h = header;
+    ++out_h;
   } while (in != end);
-  return size;
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(out_b - out_begin) + (count + 1) / 2;
 }
 
-FPC_ATTR size_t FPC_CALL fpc32_encode_separate(
-  fpc32_context_ptr_t ctx,
-  const float* FPC_RESTRICT in,
-  size_t count,
-  void* FPC_RESTRICT out_headers,
-  void* FPC_RESTRICT out_data)
+#ifdef FPC_STREAMING
+static size_t fpc_decode_separate_streaming(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT headers,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count)
 {
+  double* FPC_RESTRICT const end = out + out_count;
   const size_t fcm_mod_mask = ctx->fcm_size - 1;
   const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
-  const float* FPC_RESTRICT const end = in + count;
-  uint8_t* FPC_RESTRICT out_begin;
-  uint8_t* FPC_RESTRICT out_b;
-  uint8_t* FPC_RESTRICT out_h;
-  uint32_t
-    value, value_xor,
+  const uint8_t* FPC_RESTRICT in_data;
+  const uint8_t* FPC_RESTRICT in_h;
+  fpc_stream_t out_stream;
+  uint8_t* FPC_RESTRICT out_cursor;
+  uint64_t
     fcm_hash, dfcm_hash,
     fcm_prediction, dfcm_prediction,
     delta, last,
-    fcm_xor, dfcm_xor;
+    value;
   uint_fast8_t
     type, lzbc,
     header, i;
-  FPC_INVARIANT((uint8_t* FPC_RESTRICT)out_headers != (uint8_t* FPC_RESTRICT)out_data);
-  FPC_INVARIANT(
-    (uint8_t* FPC_RESTRICT)out_headers < (uint8_t* FPC_RESTRICT)out_data ||
-    (uint8_t* FPC_RESTRICT)out_headers + count >= (uint8_t* FPC_RESTRICT)out_data);
-  if (in == end)
+  if (out == end)
     return 0;
-  out_h = (uint8_t * FPC_RESTRICT)out_headers;
-  out_begin = out_b = (uint8_t* FPC_RESTRICT)out_data;
-  last = *(const uint32_t* FPC_RESTRICT)&ctx->delta_seed;
-  fcm_hash = dfcm_hash = fcm_prediction = dfcm_prediction = 0;
+  out_cursor = fpc_stream_init(&out_stream, out);
+  in_data = (const uint8_t* FPC_RESTRICT)in;
+  in_h = (const uint8_t* FPC_RESTRICT)headers;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
   do
   {
-    header = 0;
+    header = *in_h;
+    ++in_h;
+    FPC_PREFETCH(in_data + FPC_PREFETCH_DISTANCE * sizeof(value));
     #ifdef __clang__
       #pragma clang unroll(full)
     #elif defined(__GNUC__)
@@ -751,20 +1966,18 @@ FPC_ATTR size_t FPC_CALL fpc32_encode_separate(
     #endif
     for (i = 0; i != 2; ++i)
     {
-      value = FPC_LOAD_NT_U32(in);
-      ++in;
-      fcm_xor = value ^ fcm_prediction;
-      dfcm_xor = value ^ dfcm_prediction;
-      type = fcm_xor > dfcm_xor;
-      value_xor = type ? dfcm_xor : fcm_xor;
-      lzbc = FPC_CLZ32(value_xor) >> 3;
-      header |= (((type << 3) | lzbc)) << (i << 2);
-      lzbc = 4 - lzbc;
-      FPC_INVARIANT(lzbc <= 4);
-      FPC_MEMCPY(out_b, &value_xor, lzbc);
-      out_b += lzbc;
-      FPC_UNLIKELY_IF (in == end)
-        break;
+      type = header & 8;
+      lzbc = (header & 7);
+      lzbc += (lzbc >= FPC_LEAST_FREQUENT_LZBC);
+      lzbc = 8 - lzbc;
+      header >>= 4;
+      value = 0;
+      FPC_MEMCPY(&value, in_data, lzbc);
+      value = FPC_LE64(value);
+      value ^= type ? dfcm_prediction : fcm_prediction;
+      out_cursor = fpc_stream_write(&out_stream, out_cursor, &value, sizeof(value), sizeof(value));
+      ++out;
+      in_data += lzbc;
       delta = value - last;
       last = value;
       ctx->fcm[fcm_hash] = value;
@@ -774,26 +1987,33 @@ FPC_ATTR size_t FPC_CALL fpc32_encode_separate(
       FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
       dfcm_prediction = ctx->dfcm[dfcm_hash];
       dfcm_prediction += value;
+      FPC_UNLIKELY_IF (out == end)
+        break;
     }
-    *out_h = header;
-    ++out_h;
-  } while (in != end);
-  return (size_t)(out_b - out_begin) + (count + 1) / 2;
+  } while (out != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  fpc_stream_finish(&out_stream, out_cursor);
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in) + (out_count + 1) / 2;
 }
+#endif
 
-FPC_ATTR void FPC_CALL fpc32_decode_separate(
-  fpc32_context_ptr_t ctx,
+FPC_ATTR size_t FPC_CALL fpc_decode_separate(
+  fpc_context_ptr_t ctx,
   const void* FPC_RESTRICT headers,
   const void* FPC_RESTRICT in,
-  float* FPC_RESTRICT out,
+  double* FPC_RESTRICT out,
   size_t out_count)
 {
-  float* FPC_RESTRICT const end = out + out_count;
+  double* FPC_RESTRICT const end = out + out_count;
   const size_t fcm_mod_mask = ctx->fcm_size - 1;
   const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
   const uint8_t* FPC_RESTRICT in_data;
   const uint8_t* FPC_RESTRICT in_h;
-  uint32_t
+  uint64_t
     fcm_hash, dfcm_hash,
     fcm_prediction, dfcm_prediction,
     delta, last,
@@ -801,12 +2021,19 @@ FPC_ATTR void FPC_CALL fpc32_decode_separate(
   uint_fast8_t
     type, lzbc,
     header, i;
+#ifdef FPC_STREAMING
+  if (out_count >= FPC_STREAMING_MIN_SIZE / sizeof(uint64_t))
+    return fpc_decode_separate_streaming(ctx, headers, in, out, out_count);
+#endif
   if (out == end)
-    return;
+    return 0;
   in_data = (const uint8_t* FPC_RESTRICT)in;
   in_h = (const uint8_t* FPC_RESTRICT)headers;
-  last = *(const uint32_t* FPC_RESTRICT)&ctx->delta_seed;
-  fcm_hash = dfcm_hash = fcm_prediction = dfcm_prediction = 0;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
   do
   {
     header = *in_h;
@@ -820,15 +2047,15 @@ FPC_ATTR void FPC_CALL fpc32_decode_separate(
     {
       type = header & 8;
       lzbc = (header & 7);
-      lzbc = 4 - lzbc;
+      lzbc += (lzbc >= FPC_LEAST_FREQUENT_LZBC);
+      lzbc = 8 - lzbc;
       header >>= 4;
       value = 0;
       FPC_MEMCPY(&value, in_data, lzbc);
+      value = FPC_LE64(value);
       value ^= type ? dfcm_prediction : fcm_prediction;
-      FPC_STORE_NT_U32(out, value);
+      FPC_STORE_NT_U64(out, value);
       ++out;
-      FPC_UNLIKELY_IF (out == end)
-        return;
       in_data += lzbc;
       delta = value - last;
       last = value;
@@ -839,36 +2066,3485 @@ FPC_ATTR void FPC_CALL fpc32_decode_separate(
       FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
       dfcm_prediction = ctx->dfcm[dfcm_hash];
       dfcm_prediction += value;
+      FPC_UNLIKELY_IF (out == end)
+        break;
     }
   } while (out != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in) + (out_count + 1) / 2;
 }
 
-FPC_ATTR size_t FPC_CALL fpc32_encode(
-  fpc32_context_ptr_t ctx,
-  const float* FPC_RESTRICT in,
-  size_t count,
-  void* FPC_RESTRICT out)
+FPC_ATTR size_t FPC_CALL fpc_encode(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
 {
-  return fpc32_encode_separate(
+  return fpc_encode_separate(
     ctx,
     in,
     count,
     out,
-    (uint8_t* FPC_RESTRICT)out + FPC32_UPPER_BOUND_METADATA(count));
+    (uint8_t* FPC_RESTRICT)out + FPC_UPPER_BOUND_METADATA(count));
 }
 
-FPC_ATTR void FPC_CALL fpc32_decode(
-  fpc32_context_ptr_t ctx,
+/*
+  Grid tiling. Grids are cut into tiles of at most FPC_GRID_TILE_COUNT values, 4096 along a
+  single axis, 64 x 64 or 16 x 16 x 16, visited in row-major order. The Lorenzo predictor
+  only reads neighbours inside the current tile, so tiles encoded with their own context
+  can be decoded in any order.
+*/
+
+typedef struct fpc_grid_tile_t
+{
+  // Grid and tile extents, fastest varying axis first, padded with 1.
+  size_t size[FPC_GRID_MAX_DIMS];
+  size_t origin[FPC_GRID_MAX_DIMS];
+  size_t extent[FPC_GRID_MAX_DIMS];
+  size_t count;
+} fpc_grid_tile_t;
+
+static size_t fpc_grid_tiles(
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t* FPC_RESTRICT size,
+  size_t* FPC_RESTRICT edge,
+  size_t* FPC_RESTRICT tiles)
+{
+  size_t i, tile_edge;
+  FPC_INVARIANT(ndims != 0 && ndims <= FPC_GRID_MAX_DIMS);
+  tile_edge = ndims == 1 ? 4096 : ndims == 2 ? 64 : 16;
+  for (i = 0; i != FPC_GRID_MAX_DIMS; ++i)
+  {
+    size[i] = i < ndims ? dims[ndims - 1 - i] : 1;
+    edge[i] = i < ndims ? tile_edge : 1;
+    tiles[i] = (size[i] + edge[i] - 1) / edge[i];
+  }
+  return tiles[0] * tiles[1] * tiles[2];
+}
+
+static void fpc_grid_tile_init(
+  fpc_grid_tile_t* FPC_RESTRICT tile,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t index)
+{
+  size_t i;
+  size_t edge[FPC_GRID_MAX_DIMS];
+  size_t tiles[FPC_GRID_MAX_DIMS];
+  fpc_grid_tiles(dims, ndims, tile->size, edge, tiles);
+  FPC_INVARIANT(index < tiles[0] * tiles[1] * tiles[2]);
+  tile->count = 1;
+  for (i = 0; i != FPC_GRID_MAX_DIMS; ++i)
+  {
+    tile->origin[i] = (index % tiles[i]) * edge[i];
+    tile->extent[i] = tile->size[i] - tile->origin[i];
+    if (tile->extent[i] > edge[i])
+      tile->extent[i] = edge[i];
+    tile->count *= tile->extent[i];
+    index /= tiles[i];
+  }
+}
+
+FPC_ATTR size_t FPC_CALL fpc_grid_tile_count(
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims)
+{
+  size_t size[FPC_GRID_MAX_DIMS];
+  size_t edge[FPC_GRID_MAX_DIMS];
+  size_t tiles[FPC_GRID_MAX_DIMS];
+  return fpc_grid_tiles(dims, ndims, size, edge, tiles);
+}
+
+/*
+  Block trial encoding. The FCM and DFCM hashes only depend on the input values, so the
+  table slots a block is going to overwrite can be recorded before encoding it, and put
+  back if the block ends up being stored raw. Slots are restored in reverse order, so logs
+  recorded while encoding, which may hold the same slot more than once, work as well.
+*/
+
+typedef struct fpc_block_undo_t
+{
+  size_t fcm_index[FPC_BLOCK_COUNT];
+  size_t dfcm_index[FPC_BLOCK_COUNT];
+  uint64_t fcm[FPC_BLOCK_COUNT];
+  uint64_t dfcm[FPC_BLOCK_COUNT];
+  uint64_t fcm_hash;
+  uint64_t dfcm_hash;
+  uint64_t fcm_prediction;
+  uint64_t dfcm_prediction;
+  uint64_t last;
+} fpc_block_undo_t;
+
+static void fpc_block_snapshot(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  fpc_block_undo_t* FPC_RESTRICT undo)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint64_t value, delta, last, fcm_hash, dfcm_hash;
+  size_t i;
+  FPC_INVARIANT(count <= FPC_BLOCK_COUNT);
+  undo->fcm_hash = fcm_hash = ctx->fcm_hash;
+  undo->dfcm_hash = dfcm_hash = ctx->dfcm_hash;
+  undo->fcm_prediction = ctx->fcm_prediction;
+  undo->dfcm_prediction = ctx->dfcm_prediction;
+  undo->last = last = ctx->last;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U64(in + i);
+    delta = value - last;
+    last = value;
+    undo->fcm_index[i] = (size_t)fcm_hash;
+    undo->fcm[i] = ctx->fcm[fcm_hash];
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    undo->dfcm_index[i] = (size_t)dfcm_hash;
+    undo->dfcm[i] = ctx->dfcm[dfcm_hash];
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+  }
+}
+
+static void fpc_block_rollback(
+  fpc_context_ptr_t ctx,
+  size_t count,
+  uint_fast8_t marker,
+  const fpc_block_undo_t* FPC_RESTRICT undo)
+{
+  size_t i;
+  if (marker != FPC_BLOCK_DFCM)
+  {
+    for (i = count; i != 0; --i)
+      ctx->fcm[undo->fcm_index[i - 1]] = undo->fcm[i - 1];
+  }
+  if (marker != FPC_BLOCK_FCM)
+  {
+    for (i = count; i != 0; --i)
+      ctx->dfcm[undo->dfcm_index[i - 1]] = undo->dfcm[i - 1];
+  }
+  ctx->fcm_hash = undo->fcm_hash;
+  ctx->dfcm_hash = undo->dfcm_hash;
+  ctx->fcm_prediction = undo->fcm_prediction;
+  ctx->dfcm_prediction = undo->dfcm_prediction;
+  ctx->last = undo->last;
+}
+
+/*
+  Fast profile: blocks run a single predictor, chosen from the leading zero bytes it
+  would have produced over the first FPC_FAST_SAMPLE_COUNT values of the block, read
+  without updating the tables. With no type bit, every header nibble is a plain leading
+  zero byte count.
+*/
+
+static uint_fast8_t fpc_block_choose(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint64_t value, delta, last, fcm_hash, dfcm_hash;
+  size_t i, fcm_score, dfcm_score;
+  if (count > FPC_FAST_SAMPLE_COUNT)
+    count = FPC_FAST_SAMPLE_COUNT;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  last = ctx->last;
+  fcm_score = dfcm_score = 0;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U64(in + i);
+    fcm_score += FPC_LZBC64(value ^ ctx->fcm[fcm_hash]);
+    dfcm_score += FPC_LZBC64(value ^ (uint64_t)(ctx->dfcm[dfcm_hash] + last));
+    delta = value - last;
+    last = value;
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+  }
+  return dfcm_score > fcm_score ? FPC_BLOCK_DFCM : FPC_BLOCK_FCM;
+}
+
+static size_t fpc_block_encode_fast(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  uint_fast8_t marker,
+  void* FPC_RESTRICT out,
+  fpc_block_undo_t* FPC_RESTRICT undo)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const double* FPC_RESTRICT const end = in + count;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_b;
+  size_t j;
+  uint64_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    prediction, delta, last;
+  uint_fast8_t lzbc, header, i;
+  FPC_INVARIANT(count != 0 && count <= FPC_BLOCK_COUNT);
+  out_h = (uint8_t* FPC_RESTRICT)out;
+  out_b = out_h + FPC_UPPER_BOUND_METADATA(count);
+  undo->fcm_hash = fcm_hash = ctx->fcm_hash;
+  undo->dfcm_hash = dfcm_hash = ctx->dfcm_hash;
+  undo->fcm_prediction = ctx->fcm_prediction;
+  undo->dfcm_prediction = ctx->dfcm_prediction;
+  undo->last = last = ctx->last;
+  j = 0;
+  if (marker == FPC_BLOCK_FCM)
+  {
+    prediction = ctx->fcm[fcm_hash];
+    do
+    {
+      header = 0;
+      for (i = 0; i != 2; ++i)
+      {
+        value = FPC_LOAD_NT_U64(in);
+        ++in;
+        value_xor = value ^ prediction;
+        lzbc = FPC_LZBC64(value_xor);
+        header |= lzbc << (i << 2);
+        value_xor = FPC_LE64(value_xor);
+        FPC_MEMCPY(out_b, &value_xor, 8 - lzbc);
+        out_b += 8 - lzbc;
+        last = value;
+        undo->fcm_index[j] = (size_t)fcm_hash;
+        undo->fcm[j] = ctx->fcm[fcm_hash];
+        ++j;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        prediction = ctx->fcm[fcm_hash];
+        FPC_UNLIKELY_IF (in == end)
+          break;
+      }
+      *out_h = header;
+      ++out_h;
+    } while (in != end);
+    ctx->fcm_prediction = prediction;
+  }
+  else
+  {
+    prediction = ctx->dfcm[dfcm_hash] + last;
+    do
+    {
+      header = 0;
+      for (i = 0; i != 2; ++i)
+      {
+        value = FPC_LOAD_NT_U64(in);
+        ++in;
+        value_xor = value ^ prediction;
+        lzbc = FPC_LZBC64(value_xor);
+        header |= lzbc << (i << 2);
+        value_xor = FPC_LE64(value_xor);
+        FPC_MEMCPY(out_b, &value_xor, 8 - lzbc);
+        out_b += 8 - lzbc;
+        delta = value - last;
+        last = value;
+        undo->dfcm_index[j] = (size_t)dfcm_hash;
+        undo->dfcm[j] = ctx->dfcm[dfcm_hash];
+        ++j;
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        prediction = ctx->dfcm[dfcm_hash] + value;
+        FPC_UNLIKELY_IF (in == end)
+          break;
+      }
+      *out_h = header;
+      ++out_h;
+    } while (in != end);
+    ctx->dfcm_prediction = prediction;
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->last = last;
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+static size_t fpc_block_decode_fast(
+  fpc_context_ptr_t ctx,
   const void* FPC_RESTRICT in,
-  float* FPC_RESTRICT out,
+  double* FPC_RESTRICT out,
+  size_t out_count,
+  uint_fast8_t marker)
+{
+  double* FPC_RESTRICT const end = out + out_count;
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const uint8_t* FPC_RESTRICT in_data;
+  const uint8_t* FPC_RESTRICT in_h;
+  uint64_t
+    fcm_hash, dfcm_hash,
+    prediction, delta, last,
+    value;
+  uint_fast8_t lzbc, header, i;
+  FPC_INVARIANT(out_count != 0);
+  in_h = (const uint8_t* FPC_RESTRICT)in;
+  in_data = in_h + FPC_UPPER_BOUND_METADATA(out_count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  last = ctx->last;
+  if (marker == FPC_BLOCK_FCM)
+  {
+    prediction = ctx->fcm[fcm_hash];
+    do
+    {
+      header = *in_h;
+      ++in_h;
+      for (i = 0; i != 2; ++i)
+      {
+        lzbc = 8 - (header & 15);
+        header >>= 4;
+        value = 0;
+        FPC_MEMCPY(&value, in_data, lzbc);
+        value = FPC_LE64(value);
+        value ^= prediction;
+        FPC_STORE_NT_U64(out, value);
+        ++out;
+        in_data += lzbc;
+        last = value;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        prediction = ctx->fcm[fcm_hash];
+        FPC_UNLIKELY_IF (out == end)
+          break;
+      }
+    } while (out != end);
+    ctx->fcm_prediction = prediction;
+  }
+  else
+  {
+    prediction = ctx->dfcm[dfcm_hash] + last;
+    do
+    {
+      header = *in_h;
+      ++in_h;
+      for (i = 0; i != 2; ++i)
+      {
+        lzbc = 8 - (header & 15);
+        header >>= 4;
+        value = 0;
+        FPC_MEMCPY(&value, in_data, lzbc);
+        value = FPC_LE64(value);
+        value ^= prediction;
+        FPC_STORE_NT_U64(out, value);
+        ++out;
+        in_data += lzbc;
+        delta = value - last;
+        last = value;
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        prediction = ctx->dfcm[dfcm_hash] + value;
+        FPC_UNLIKELY_IF (out == end)
+          break;
+      }
+    } while (out != end);
+    ctx->dfcm_prediction = prediction;
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+static size_t fpc_block_trial(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  FPC_BOOL fast,
+  uint8_t* FPC_RESTRICT out,
+  fpc_block_undo_t* FPC_RESTRICT undo,
+  uint_fast8_t* FPC_RESTRICT marker)
+{
+  if (fast)
+  {
+    *marker = fpc_block_choose(ctx, in, count);
+    return fpc_block_encode_fast(ctx, in, count, *marker, out, undo);
+  }
+  *marker = FPC_BLOCK_FPC;
+  fpc_block_snapshot(ctx, in, count, undo);
+  return fpc_encode(ctx, in, count, out);
+}
+
+static size_t fpc_encode_blocks_profile(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out,
+  FPC_BOOL fast,
+  FPC_BOOL adaptive,
+  size_t restart_count)
+{
+  fpc_block_undo_t undo;
+  uint8_t scratch[FPC_UPPER_BOUND(FPC_BLOCK_COUNT)];
+  uint8_t* FPC_RESTRICT out_b;
+  size_t offset, step, raw_size, size, average, since_change, since_restart, seed_budget;
+  uint_fast8_t marker, flags;
+  out_b = (uint8_t* FPC_RESTRICT)out;
+  average = since_change = since_restart = 0;
+  // The tables may not know the data yet, as after a regime change.
+  seed_budget = ctx->fcm_size;
+  for (offset = 0; offset != count; offset += step)
+  {
+    step = count - offset;
+    if (step > FPC_BLOCK_COUNT)
+      step = FPC_BLOCK_COUNT;
+    raw_size = step * sizeof(uint64_t);
+    flags = 0;
+    FPC_UNLIKELY_IF (restart_count != 0 && since_restart >= restart_count * 2)
+    {
+      fpc_context_reset(ctx);
+      flags = FPC_BLOCK_RESET;
+      since_restart = 0;
+    }
+    size = fpc_block_trial(ctx, in + offset, step, fast, scratch, &undo, &marker);
+    if (adaptive)
+    {
+      FPC_UNLIKELY_IF (since_change >= FPC_ADAPTIVE_MIN_BLOCKS && FPC_ADAPTIVE_JUMPED(size, average >> FPC_ADAPTIVE_AVERAGE_SHIFT, raw_size))
+      {
+        // New regime: a good place for a restart point, and the tables have to learn it.
+        if (restart_count != 0 && since_restart >= restart_count && flags == 0)
+        {
+          fpc_block_rollback(ctx, step, marker, &undo);
+          fpc_context_reset(ctx);
+          flags = FPC_BLOCK_RESET;
+          since_restart = 0;
+          size = fpc_block_trial(ctx, in + offset, step, fast, scratch, &undo, &marker);
+        }
+        seed_budget = ctx->fcm_size;
+        since_change = 0;
+      }
+      if (since_change == 0)
+        average = size << FPC_ADAPTIVE_AVERAGE_SHIFT;
+      average += size - (average >> FPC_ADAPTIVE_AVERAGE_SHIFT);
+      ++since_change;
+    }
+    since_restart += step;
+    if (size + (raw_size >> FPC_BLOCK_MIN_GAIN_SHIFT) > raw_size)
+    {
+      if (adaptive && seed_budget >= step)
+      {
+        // Keep the updates, so data that comes back later in the regime is predicted.
+        flags |= FPC_BLOCK_SEED;
+        seed_budget -= step;
+      }
+      else
+      {
+        fpc_block_rollback(ctx, step, marker, &undo);
+      }
+      *out_b = (uint8_t)(FPC_BLOCK_RAW | flags);
+      ++out_b;
+      fpc_copy_le(out_b, in + offset, step);
+      out_b += raw_size;
+    }
+    else
+    {
+      *out_b = (uint8_t)(marker | flags);
+      ++out_b;
+      FPC_MEMCPY(out_b, scratch, size);
+      out_b += size;
+    }
+  }
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_blocks(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  return fpc_encode_blocks_profile(ctx, in, count, out, 0, 0, 0);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_blocks_fast(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  return fpc_encode_blocks_profile(ctx, in, count, out, 1, 0, 0);
+}
+
+static size_t fpc_block_size(
+  const uint8_t* FPC_RESTRICT in,
+  size_t count,
+  uint_fast8_t marker)
+{
+  size_t size, i;
+  uint_fast8_t lzbc;
+  if (marker == FPC_BLOCK_RAW)
+    return count * sizeof(uint64_t);
+  size = FPC_UPPER_BOUND_METADATA(count);
+  for (i = 0; i != count; ++i)
+  {
+    lzbc = (in[i >> 1] >> ((i & 1) << 2)) & 15;
+    if (marker == FPC_BLOCK_FPC)
+    {
+      lzbc &= 7;
+      lzbc += (lzbc >= FPC_LEAST_FREQUENT_LZBC);
+    }
+    size += 8 - lzbc;
+  }
+  return size;
+}
+
+static size_t fpc_decode_blocks_profile(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count)
+{
+  const uint8_t* FPC_RESTRICT in_b;
+  size_t offset, step;
+  uint_fast8_t marker;
+  in_b = (const uint8_t* FPC_RESTRICT)in;
+  for (offset = 0; offset != out_count; offset += step)
+  {
+    step = out_count - offset;
+    if (step > FPC_BLOCK_COUNT)
+      step = FPC_BLOCK_COUNT;
+    marker = *in_b;
+    ++in_b;
+    FPC_UNLIKELY_IF ((marker & FPC_BLOCK_RESET) != 0)
+    {
+      fpc_context_reset(ctx);
+      marker &= ~FPC_BLOCK_RESET;
+    }
+    FPC_LIKELY_IF (marker == FPC_BLOCK_FPC)
+    {
+      in_b += fpc_decode(ctx, in_b, out + offset, step);
+    }
+    else if (marker == FPC_BLOCK_RAW)
+    {
+      fpc_copy_le(out + offset, in_b, step);
+      in_b += step * sizeof(uint64_t);
+    }
+    else if (marker == (FPC_BLOCK_RAW | FPC_BLOCK_SEED))
+    {
+      fpc_copy_le(out + offset, in_b, step);
+      in_b += step * sizeof(uint64_t);
+      (void)fpc_encode_size(ctx, out + offset, step);
+    }
+    else
+    {
+      FPC_INVARIANT(marker == FPC_BLOCK_FCM || marker == FPC_BLOCK_DFCM);
+      in_b += fpc_block_decode_fast(ctx, in_b, out + offset, step, marker);
+    }
+  }
+  return (size_t)(in_b - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_blocks(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count)
+{
+  return fpc_decode_blocks_profile(ctx, in, out, out_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_blocks_adaptive(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  size_t restart_count,
+  void* FPC_RESTRICT out)
+{
+  return fpc_encode_blocks_profile(ctx, in, count, out, 0, 1, restart_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_blocks_adaptive(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count)
+{
+  return fpc_decode_blocks_profile(ctx, in, out, out_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_blocks_find_restart(
+  const void* FPC_RESTRICT in,
+  size_t count,
+  size_t index,
+  size_t* FPC_RESTRICT restart_index)
+{
+  const uint8_t* FPC_RESTRICT in_b;
+  size_t offset, step, restart;
+  uint_fast8_t marker;
+  in_b = (const uint8_t* FPC_RESTRICT)in;
+  restart = 0;
+  *restart_index = 0;
+  for (offset = 0; offset < count && offset <= index; offset += step)
+  {
+    step = count - offset;
+    if (step > FPC_BLOCK_COUNT)
+      step = FPC_BLOCK_COUNT;
+    marker = *in_b;
+    if ((marker & FPC_BLOCK_RESET) != 0)
+    {
+      restart = (size_t)(in_b - (const uint8_t* FPC_RESTRICT)in);
+      *restart_index = offset;
+    }
+    ++in_b;
+    in_b += fpc_block_size(in_b, step, marker & ~(FPC_BLOCK_RESET | FPC_BLOCK_SEED));
+  }
+  return restart;
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_buffer(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  fpc_buffer_t* FPC_RESTRICT out)
+{
+  const size_t header_size = FPC_UPPER_BOUND_METADATA(count);
+  size_t offset, step, data_size;
+  uint8_t* FPC_RESTRICT base;
+  data_size = 0;
+  for (offset = 0; offset != count; offset += step)
+  {
+    step = count - offset;
+    if (step > FPC_BUFFER_STEP_COUNT)
+      step = FPC_BUFFER_STEP_COUNT;
+    if (!fpc_buffer_reserve(out, out->size + header_size + data_size + FPC_UPPER_BOUND_DATA(step)))
+      return FPC_BUFFER_ERROR;
+    base = (uint8_t* FPC_RESTRICT)out->data + out->size;
+    data_size += fpc_encode_separate(
+      ctx,
+      in + offset,
+      step,
+      base + offset / 2,
+      base + header_size + data_size) - (step + 1) / 2;
+  }
+  out->size += header_size + data_size;
+  return header_size + data_size;
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
   size_t out_count)
 {
-  fpc32_decode_separate(
+  return fpc_decode_separate(
     ctx,
     in,
-    (const uint8_t* FPC_RESTRICT)in + FPC32_UPPER_BOUND_METADATA(out_count),
+    (const uint8_t* FPC_RESTRICT)in + FPC_UPPER_BOUND_METADATA(out_count),
     out,
     out_count);
 }
 
+FPC_ATTR size_t FPC_CALL fpc_encode_channels(
+  fpc_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const double* FPC_RESTRICT in,
+  size_t frames,
+  void* FPC_RESTRICT out)
+{
+  const size_t count = frames * nchannels;
+  fpc_context_t* FPC_RESTRICT ctx;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint64_t
+    value, value_xor,
+    delta,
+    fcm_xor, dfcm_xor;
+  uint_fast8_t
+    type, lzbc,
+    header;
+  size_t fcm_mod_mask, dfcm_mod_mask, frame, channel, i;
+  if (count == 0)
+    return 0;
+  out_h = (uint8_t* FPC_RESTRICT)out;
+  out_begin = out_b = out_h + FPC_UPPER_BOUND_METADATA(count);
+  header = 0;
+  i = 0;
+  for (frame = 0; frame != frames; ++frame)
+  {
+    // Channels only share the output, so their dependency chains overlap.
+    for (channel = 0; channel != nchannels; ++channel, ++i)
+    {
+      ctx = ctxs + channel;
+      fcm_mod_mask = ctx->fcm_size - 1;
+      dfcm_mod_mask = ctx->dfcm_size - 1;
+      value = FPC_LOAD_NT_U64(in + i);
+      fcm_xor = value ^ ctx->fcm_prediction;
+      dfcm_xor = value ^ ctx->dfcm_prediction;
+      type = fcm_xor > dfcm_xor;
+      value_xor = type ? dfcm_xor : fcm_xor;
+      lzbc = FPC_LZBC64(value_xor);
+      header |= (((type << 3) | (lzbc - (lzbc >= FPC_LEAST_FREQUENT_LZBC)))) << ((i & 1) << 2);
+      lzbc -= (lzbc == FPC_LEAST_FREQUENT_LZBC);
+      lzbc = 8 - lzbc;
+      FPC_INVARIANT(lzbc <= 8);
+      value_xor = FPC_LE64(value_xor);
+      FPC_MEMCPY(out_b, &value_xor, lzbc);
+      out_b += lzbc;
+      if ((i & 1) == 1)
+      {
+        *out_h = (uint8_t)header;
+        ++out_h;
+        header = 0;
+      }
+      delta = value - ctx->last;
+      ctx->last = value;
+      ctx->fcm[ctx->fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(ctx->fcm_hash, value);
+      ctx->fcm_prediction = ctx->fcm[ctx->fcm_hash];
+      ctx->dfcm[ctx->dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(ctx->dfcm_hash, delta);
+      ctx->dfcm_prediction = ctx->dfcm[ctx->dfcm_hash] + value;
+    }
+  }
+  if ((count & 1) != 0)
+    *out_h = (uint8_t)header;
+  return (size_t)(out_b - out_begin) + FPC_UPPER_BOUND_METADATA(count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_channels(
+  fpc_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t frames)
+{
+  const size_t count = frames * nchannels;
+  fpc_context_t* FPC_RESTRICT ctx;
+  const uint8_t* FPC_RESTRICT in_h;
+  const uint8_t* FPC_RESTRICT in_data;
+  uint64_t value, delta;
+  uint_fast8_t
+    type, lzbc,
+    header;
+  size_t fcm_mod_mask, dfcm_mod_mask, frame, channel, i;
+  if (count == 0)
+    return 0;
+  in_h = (const uint8_t* FPC_RESTRICT)in;
+  in_data = in_h + FPC_UPPER_BOUND_METADATA(count);
+  header = 0;
+  i = 0;
+  for (frame = 0; frame != frames; ++frame)
+  {
+    for (channel = 0; channel != nchannels; ++channel, ++i)
+    {
+      ctx = ctxs + channel;
+      fcm_mod_mask = ctx->fcm_size - 1;
+      dfcm_mod_mask = ctx->dfcm_size - 1;
+      if ((i & 1) == 0)
+      {
+        header = *in_h;
+        ++in_h;
+      }
+      type = header & 8;
+      lzbc = (header & 7);
+      lzbc += (lzbc >= FPC_LEAST_FREQUENT_LZBC);
+      lzbc = 8 - lzbc;
+      header >>= 4;
+      value = 0;
+      FPC_MEMCPY(&value, in_data, lzbc);
+      value = FPC_LE64(value);
+      value ^= type ? ctx->dfcm_prediction : ctx->fcm_prediction;
+      FPC_STORE_NT_U64(out + i, value);
+      in_data += lzbc;
+      delta = value - ctx->last;
+      ctx->last = value;
+      ctx->fcm[ctx->fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(ctx->fcm_hash, value);
+      ctx->fcm_prediction = ctx->fcm[ctx->fcm_hash];
+      ctx->dfcm[ctx->dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(ctx->dfcm_hash, delta);
+      ctx->dfcm_prediction = ctx->dfcm[ctx->dfcm_hash] + value;
+    }
+  }
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+/*
+  Sampled estimates. Windows of FPC_BLOCK_COUNT values, evenly spread over the input, are
+  each preceded by up to FPC_ESTIMATE_WARMUP_COUNT values that only update the tables.
+  Every window is encoded, rolled back and decoded again, which leaves the tables exactly
+  as a plain encode would, so the cost of both directions is measured on the same data.
+*/
+
+#ifndef FPC_ESTIMATE_WARMUP_COUNT
+  #define FPC_ESTIMATE_WARMUP_COUNT 512
+#endif
+
+static double fpc_clock_ns(void)
+{
+#ifdef TIME_UTC
+  struct timespec t;
+  (void)timespec_get(&t, TIME_UTC);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+#else
+  return 0.0;
+#endif
+}
+
+// Square root without a libm dependency. "x" is scaled by powers of 4, which is exact, into
+// [0.25, 1], where 6 Newton steps from 1 are within an ulp of the root. The scaling loops
+// run at most about 540 times, for subnormals; infinities and NaNs return early.
+static double fpc_sqrt(
+  double x)
+{
+  double root, scale;
+  uint_fast8_t i;
+  if (!(x > 0.0))
+    return 0.0;
+  if (x - x != 0.0)
+    return x;
+  scale = 1.0;
+  while (x < 0.25)
+  {
+    x *= 4.0;
+    scale *= 0.5;
+  }
+  while (x > 1.0)
+  {
+    x *= 0.25;
+    scale *= 2.0;
+  }
+  root = 1.0;
+  for (i = 0; i != 6; ++i)
+    root = (root + x / root) * 0.5;
+  return root * scale;
+}
+
+static size_t fpc_estimate_window_count(
+  size_t count,
+  double sample_fraction)
+{
+  size_t windows, max_windows;
+  max_windows = count / FPC_BLOCK_COUNT;
+  if (max_windows == 0)
+    return 1;
+  // Written so that NaN also ends up as 0.
+  if (!(sample_fraction > 0.0))
+    sample_fraction = 0.0;
+  if (sample_fraction > 1.0)
+    sample_fraction = 1.0;
+  windows = (size_t)((double)count * sample_fraction / (double)FPC_BLOCK_COUNT) + 1;
+  return windows < max_windows ? windows : max_windows;
+}
+
+static void fpc_estimate_finish(
+  fpc_estimate_t* FPC_RESTRICT est,
+  double ratio_sum,
+  double ratio_square_sum,
+  size_t windows,
+  size_t raw_windows,
+  size_t window_values)
+{
+  double mean, variance, margin;
+  mean = ratio_sum / (double)windows;
+  variance = 0.0;
+  if (windows > 1)
+    variance = (ratio_square_sum - ratio_sum * mean) / (double)(windows - 1);
+  // 95% confidence interval of the mean window ratio.
+  margin = 1.96 * fpc_sqrt(variance / (double)windows);
+  est->ratio = mean;
+  est->ratio_low = mean - margin;
+  est->ratio_high = mean + margin;
+  est->raw_block_fraction = (double)raw_windows / (double)windows;
+  est->encode_ns /= (double)window_values;
+  est->decode_ns /= (double)window_values;
+}
+
+FPC_ATTR void FPC_CALL fpc_estimate(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  double sample_fraction,
+  fpc_estimate_t* FPC_RESTRICT est)
+{
+  fpc_block_undo_t undo;
+  uint8_t encoded[FPC_UPPER_BOUND(FPC_BLOCK_COUNT)];
+  double decoded[FPC_BLOCK_COUNT];
+  double ratio, ratio_sum, ratio_square_sum, start;
+  size_t i, windows, raw_windows, stride, window, warmup, offset, size, raw_size;
+  FPC_MEMSET(est, 0, sizeof(fpc_estimate_t));
+  if (count == 0)
+    return;
+  fpc_context_reset(ctx);
+  windows = fpc_estimate_window_count(count, sample_fraction);
+  stride = count / windows;
+  window = stride < FPC_BLOCK_COUNT ? stride : FPC_BLOCK_COUNT;
+  raw_size = window * sizeof(double);
+  ratio_sum = ratio_square_sum = 0.0;
+  raw_windows = 0;
+  for (i = 0; i != windows; ++i)
+  {
+    // Each window sits at the end of its stride, after its warm-up values.
+    offset = i * stride + stride - window;
+    warmup = offset - i * stride;
+    if (warmup > FPC_ESTIMATE_WARMUP_COUNT)
+      warmup = FPC_ESTIMATE_WARMUP_COUNT;
+    (void)fpc_encode_size(ctx, in + offset - warmup, warmup);
+    fpc_block_snapshot(ctx, in + offset, window, &undo);
+    start = fpc_clock_ns();
+    size = fpc_encode(ctx, in + offset, window, encoded);
+    est->encode_ns += fpc_clock_ns() - start;
+    fpc_block_rollback(ctx, window, FPC_BLOCK_FPC, &undo);
+    start = fpc_clock_ns();
+    (void)fpc_decode(ctx, encoded, decoded, window);
+    est->decode_ns += fpc_clock_ns() - start;
+    ratio = (double)size / (double)raw_size;
+    ratio_sum += ratio;
+    ratio_square_sum += ratio * ratio;
+    if (size + (raw_size >> FPC_BLOCK_MIN_GAIN_SHIFT) > raw_size)
+      ++raw_windows;
+    est->sampled_count += warmup + window;
+  }
+  fpc_estimate_finish(est, ratio_sum, ratio_square_sum, windows, raw_windows, windows * window);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_ref(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  const double* FPC_RESTRICT ref,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint8_t* FPC_RESTRICT out_t;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint64_t
+    value, value_xor, reference,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last, ref_delta,
+    candidate_xor;
+  uint_fast8_t
+    type, lzbc,
+    types, header;
+  size_t i;
+  if (count == 0)
+    return 0;
+  out_t = (uint8_t* FPC_RESTRICT)out;
+  out_h = out_t + FPC_REF_TYPES_SIZE(count);
+  out_begin = out_b = out_h + FPC_UPPER_BOUND_METADATA(count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  ref_delta = 0;
+  types = header = 0;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U64(in + i);
+    reference = FPC_LOAD_NT_U64(ref + i);
+    type = FPC_REF_FCM;
+    value_xor = value ^ fcm_prediction;
+    candidate_xor = value ^ dfcm_prediction;
+    if (candidate_xor < value_xor)
+    {
+      type = FPC_REF_DFCM;
+      value_xor = candidate_xor;
+    }
+    candidate_xor = value ^ reference;
+    if (candidate_xor < value_xor)
+    {
+      type = FPC_REF_SNAPSHOT;
+      value_xor = candidate_xor;
+    }
+    candidate_xor = value ^ (reference + ref_delta);
+    if (candidate_xor < value_xor)
+    {
+      type = FPC_REF_SNAPSHOT_DELTA;
+      value_xor = candidate_xor;
+    }
+    lzbc = FPC_LZBC64(value_xor);
+    types |= type << ((i & 3) << 1);
+    header |= lzbc << ((i & 1) << 2);
+    if ((i & 3) == 3)
+    {
+      *out_t = (uint8_t)types;
+      ++out_t;
+      types = 0;
+    }
+    if ((i & 1) == 1)
+    {
+      *out_h = (uint8_t)header;
+      ++out_h;
+      header = 0;
+    }
+    value_xor = FPC_LE64(value_xor);
+    FPC_MEMCPY(out_b, &value_xor, 8 - lzbc);
+    out_b += 8 - lzbc;
+    ref_delta = value - reference;
+    delta = value - last;
+    last = value;
+    ctx->fcm[fcm_hash] = value;
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    fcm_prediction = ctx->fcm[fcm_hash];
+    ctx->dfcm[dfcm_hash] = delta;
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+    dfcm_prediction = ctx->dfcm[dfcm_hash];
+    dfcm_prediction += value;
+  }
+  if ((count & 3) != 0)
+    *out_t = (uint8_t)types;
+  if ((count & 1) != 0)
+    *out_h = (uint8_t)header;
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(out_b - out_begin) + FPC_REF_TYPES_SIZE(count) + FPC_UPPER_BOUND_METADATA(count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_ref(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const double* FPC_RESTRICT ref,
+  double* FPC_RESTRICT out,
+  size_t out_count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const uint8_t* FPC_RESTRICT in_t;
+  const uint8_t* FPC_RESTRICT in_h;
+  const uint8_t* FPC_RESTRICT in_data;
+  uint64_t
+    value, reference, prediction,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last, ref_delta;
+  uint_fast8_t type, lzbc;
+  size_t i;
+  if (out_count == 0)
+    return 0;
+  in_t = (const uint8_t* FPC_RESTRICT)in;
+  in_h = in_t + FPC_REF_TYPES_SIZE(out_count);
+  in_data = in_h + FPC_UPPER_BOUND_METADATA(out_count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  ref_delta = 0;
+  for (i = 0; i != out_count; ++i)
+  {
+    type = (in_t[i >> 2] >> ((i & 3) << 1)) & 3;
+    lzbc = 8 - ((in_h[i >> 1] >> ((i & 1) << 2)) & 15);
+    reference = FPC_LOAD_NT_U64(ref + i);
+    switch (type)
+    {
+    case FPC_REF_FCM:
+      prediction = fcm_prediction;
+      break;
+    case FPC_REF_DFCM:
+      prediction = dfcm_prediction;
+      break;
+    case FPC_REF_SNAPSHOT:
+      prediction = reference;
+      break;
+    default:
+      prediction = reference + ref_delta;
+      break;
+    }
+    value = 0;
+    FPC_MEMCPY(&value, in_data, lzbc);
+    value = FPC_LE64(value);
+    value ^= prediction;
+    FPC_STORE_NT_U64(out + i, value);
+    in_data += lzbc;
+    ref_delta = value - reference;
+    delta = value - last;
+    last = value;
+    ctx->fcm[fcm_hash] = value;
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    fcm_prediction = ctx->fcm[fcm_hash];
+    ctx->dfcm[dfcm_hash] = delta;
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+    dfcm_prediction = ctx->dfcm[dfcm_hash];
+    dfcm_prediction += value;
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+// Returns the bit pattern of the prediction, with every NaN mapped to FPC_GRID_NAN64, since
+// the sign and payload of a NaN produced by an operation differ between platforms.
+static FPC_INLINE uint64_t fpc_grid_lorenzo(
+  const double* FPC_RESTRICT p,
+  size_t row,
+  size_t plane,
+  FPC_BOOL has_x,
+  FPC_BOOL has_y,
+  FPC_BOOL has_z)
+{
+  double prediction = 0;
+  uint64_t bits;
+  if (has_x)
+    prediction = FPC_GRID_ROUND64(prediction + p[-1]);
+  if (has_y)
+  {
+    prediction = FPC_GRID_ROUND64(prediction + *(p - row));
+    if (has_x)
+      prediction = FPC_GRID_ROUND64(prediction - *(p - row - 1));
+  }
+  if (has_z)
+  {
+    prediction = FPC_GRID_ROUND64(prediction + *(p - plane));
+    if (has_x)
+      prediction = FPC_GRID_ROUND64(prediction - *(p - plane - 1));
+    if (has_y)
+    {
+      prediction = FPC_GRID_ROUND64(prediction - *(p - plane - row));
+      if (has_x)
+        prediction = FPC_GRID_ROUND64(prediction + *(p - plane - row - 1));
+    }
+  }
+  FPC_MEMCPY(&bits, &prediction, sizeof(bits));
+  if ((uint64_t)(bits << 1) > (uint64_t)(FPC_GRID_INF64 << 1))
+    bits = FPC_GRID_NAN64;
+  return bits;
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_grid_tile(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile_index,
+  void* FPC_RESTRICT out)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  fpc_grid_tile_t tile;
+  const double* FPC_RESTRICT row;
+  uint8_t* FPC_RESTRICT out_t;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint64_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    lorenzo_prediction,
+    delta, last,
+    candidate_xor;
+  uint_fast8_t
+    type, lzbc,
+    types, header;
+  size_t i, x, y, z, plane;
+  fpc_grid_tile_init(&tile, dims, ndims, tile_index);
+  plane = tile.size[0] * tile.size[1];
+  out_t = (uint8_t* FPC_RESTRICT)out;
+  out_h = out_t + FPC_REF_TYPES_SIZE(tile.count);
+  out_begin = out_b = out_h + FPC_UPPER_BOUND_METADATA(tile.count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  types = header = 0;
+  i = 0;
+  for (z = 0; z != tile.extent[2]; ++z)
+  {
+    for (y = 0; y != tile.extent[1]; ++y)
+    {
+      row = in + (tile.origin[2] + z) * plane + (tile.origin[1] + y) * tile.size[0] + tile.origin[0];
+      for (x = 0; x != tile.extent[0]; ++x, ++i)
+      {
+        lorenzo_prediction = fpc_grid_lorenzo(row + x, tile.size[0], plane, x != 0, y != 0, z != 0);
+        FPC_MEMCPY(&value, row + x, sizeof(value));
+        type = FPC_GRID_FCM;
+        value_xor = value ^ fcm_prediction;
+        candidate_xor = value ^ dfcm_prediction;
+        if (candidate_xor < value_xor)
+        {
+          type = FPC_GRID_DFCM;
+          value_xor = candidate_xor;
+        }
+        candidate_xor = value ^ lorenzo_prediction;
+        if (candidate_xor < value_xor)
+        {
+          type = FPC_GRID_LORENZO;
+          value_xor = candidate_xor;
+        }
+        lzbc = FPC_LZBC64(value_xor);
+        types |= type << ((i & 3) << 1);
+        header |= lzbc << ((i & 1) << 2);
+        if ((i & 3) == 3)
+        {
+          *out_t = (uint8_t)types;
+          ++out_t;
+          types = 0;
+        }
+        if ((i & 1) == 1)
+        {
+          *out_h = (uint8_t)header;
+          ++out_h;
+          header = 0;
+        }
+        value_xor = FPC_LE64(value_xor);
+        FPC_MEMCPY(out_b, &value_xor, 8 - lzbc);
+        out_b += 8 - lzbc;
+        delta = value - last;
+        last = value;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        fcm_prediction = ctx->fcm[fcm_hash];
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        dfcm_prediction = ctx->dfcm[dfcm_hash];
+        dfcm_prediction += value;
+      }
+    }
+  }
+  if ((tile.count & 3) != 0)
+    *out_t = (uint8_t)types;
+  if ((tile.count & 1) != 0)
+    *out_h = (uint8_t)header;
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(out_b - out_begin) + FPC_REF_TYPES_SIZE(tile.count) + FPC_UPPER_BOUND_METADATA(tile.count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_grid_tile(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile_index,
+  double* FPC_RESTRICT out)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  fpc_grid_tile_t tile;
+  double* FPC_RESTRICT row;
+  const uint8_t* FPC_RESTRICT in_t;
+  const uint8_t* FPC_RESTRICT in_h;
+  const uint8_t* FPC_RESTRICT in_data;
+  uint64_t
+    value, prediction,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last;
+  uint_fast8_t type, lzbc;
+  size_t i, x, y, z, plane;
+  fpc_grid_tile_init(&tile, dims, ndims, tile_index);
+  plane = tile.size[0] * tile.size[1];
+  in_t = (const uint8_t* FPC_RESTRICT)in;
+  in_h = in_t + FPC_REF_TYPES_SIZE(tile.count);
+  in_data = in_h + FPC_UPPER_BOUND_METADATA(tile.count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  i = 0;
+  for (z = 0; z != tile.extent[2]; ++z)
+  {
+    for (y = 0; y != tile.extent[1]; ++y)
+    {
+      row = out + (tile.origin[2] + z) * plane + (tile.origin[1] + y) * tile.size[0] + tile.origin[0];
+      for (x = 0; x != tile.extent[0]; ++x, ++i)
+      {
+        type = (in_t[i >> 2] >> ((i & 3) << 1)) & 3;
+        lzbc = 8 - ((in_h[i >> 1] >> ((i & 1) << 2)) & 15);
+        if (type == FPC_GRID_FCM)
+        {
+          prediction = fcm_prediction;
+        }
+        else if (type == FPC_GRID_DFCM)
+        {
+          prediction = dfcm_prediction;
+        }
+        else
+        {
+          prediction = fpc_grid_lorenzo(row + x, tile.size[0], plane, x != 0, y != 0, z != 0);
+        }
+        value = 0;
+        FPC_MEMCPY(&value, in_data, lzbc);
+        value = FPC_LE64(value);
+        value ^= prediction;
+        FPC_MEMCPY(row + x, &value, sizeof(value));
+        in_data += lzbc;
+        delta = value - last;
+        last = value;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        fcm_prediction = ctx->fcm[fcm_hash];
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        dfcm_prediction = ctx->dfcm[dfcm_hash];
+        dfcm_prediction += value;
+      }
+    }
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_grid(
+  fpc_context_ptr_t ctx,
+  const double* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  void* FPC_RESTRICT out)
+{
+  uint8_t* FPC_RESTRICT out_b = (uint8_t* FPC_RESTRICT)out;
+  size_t i, tile_count;
+  tile_count = fpc_grid_tile_count(dims, ndims);
+  for (i = 0; i != tile_count; ++i)
+    out_b += fpc_encode_grid_tile(ctx, in, dims, ndims, i, out_b);
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_grid(
+  fpc_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  double* FPC_RESTRICT out)
+{
+  const uint8_t* FPC_RESTRICT in_b = (const uint8_t* FPC_RESTRICT)in;
+  size_t i, tile_count;
+  tile_count = fpc_grid_tile_count(dims, ndims);
+  for (i = 0; i != tile_count; ++i)
+    in_b += fpc_decode_grid_tile(ctx, in_b, dims, ndims, i, out);
+  return (size_t)(in_b - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR uint32_t FPC_CALL fpc_dictionary_id(
+  const void* FPC_RESTRICT in)
+{
+  uint32_t id;
+  FPC_MEMCPY(&id, in, FPC_DICTIONARY_HEADER_SIZE);
+  return FPC_LE32(id);
+}
+
+FPC_ATTR void FPC_CALL fpc_dictionary_train(
+  fpc_context_ptr_t ctx,
+  const double* const* FPC_RESTRICT samples,
+  const size_t* FPC_RESTRICT sample_counts,
+  size_t sample_count)
+{
+  size_t i;
+  fpc_context_reset(ctx);
+  for (i = 0; i != sample_count; ++i)
+  {
+    fpc_context_reset_state(ctx);
+    (void)fpc_encode_size(ctx, samples[i], sample_counts[i]);
+  }
+  fpc_context_reset_state(ctx);
+}
+
+FPC_ATTR void FPC_CALL fpc_context_load_dictionary(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict)
+{
+  FPC_INVARIANT(ctx->fcm_size == dict->fcm_size);
+  FPC_INVARIANT(ctx->dfcm_size == dict->dfcm_size);
+  FPC_MEMCPY(ctx->fcm, dict->fcm, ctx->fcm_size * sizeof(uint64_t));
+  FPC_MEMCPY(ctx->dfcm, dict->dfcm, ctx->dfcm_size * sizeof(uint64_t));
+  fpc_context_reset_state(ctx);
+}
+
+/*
+  Dictionary messages start from the dictionary tables and put them back when they are
+  done. The hashes only depend on the values, so the slots a message wrote are found again
+  by replaying them over the message, and copied back from the dictionary, in O(message).
+*/
+
+static void fpc_dictionary_restore(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict,
+  const double* FPC_RESTRICT values,
+  size_t count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint64_t value, delta, last, fcm_hash, dfcm_hash;
+  size_t i;
+  fpc_context_reset_state(ctx);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  last = ctx->last;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U64(values + i);
+    delta = value - last;
+    last = value;
+    ctx->fcm[fcm_hash] = dict->fcm[fcm_hash];
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    ctx->dfcm[dfcm_hash] = dict->dfcm[dfcm_hash];
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+  }
+}
+
+FPC_ATTR size_t FPC_CALL fpc_encode_dictionary(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict,
+  const double* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  uint32_t id;
+  size_t size;
+  id = FPC_LE32(dict->id);
+  FPC_MEMCPY(out, &id, FPC_DICTIONARY_HEADER_SIZE);
+  fpc_context_reset_state(ctx);
+  size = fpc_encode(ctx, in, count, (uint8_t* FPC_RESTRICT)out + FPC_DICTIONARY_HEADER_SIZE);
+  fpc_dictionary_restore(ctx, dict, in, count);
+  return FPC_DICTIONARY_HEADER_SIZE + size;
+}
+
+FPC_ATTR size_t FPC_CALL fpc_decode_dictionary(
+  fpc_context_ptr_t ctx,
+  const fpc_dictionary_t* FPC_RESTRICT dict,
+  const void* FPC_RESTRICT in,
+  double* FPC_RESTRICT out,
+  size_t out_count)
+{
+  size_t size;
+  if (fpc_dictionary_id(in) != dict->id)
+    return 0;
+  fpc_context_reset_state(ctx);
+  size = fpc_decode(ctx, (const uint8_t* FPC_RESTRICT)in + FPC_DICTIONARY_HEADER_SIZE, out, out_count);
+  fpc_dictionary_restore(ctx, dict, out, out_count);
+  return FPC_DICTIONARY_HEADER_SIZE + size;
+}
+
+static void fpc32_context_reset_state(
+  fpc32_context_ptr_t ctx)
+{
+  ctx->fcm_hash = ctx->dfcm_hash = 0;
+  ctx->fcm_prediction = ctx->dfcm_prediction = 0;
+  FPC_MEMCPY(&ctx->last, &ctx->delta_seed, sizeof(uint32_t));
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_init(
+  fpc32_context_ptr_t ctx,
+  uint32_t* FPC_RESTRICT fcm,
+  uint32_t* FPC_RESTRICT dfcm,
+  size_t fcm_size,
+  size_t dfcm_size,
+  fpc_hash_args_t hash_args,
+  float delta_seed)
+{
+  FPC_INVARIANT(FPC_IS_POW2(fcm_size));
+  FPC_INVARIANT(FPC_IS_POW2(dfcm_size));
+  ctx->fcm = fcm;
+  ctx->dfcm = dfcm;
+  ctx->fcm_size = fcm_size;
+  ctx->dfcm_size = dfcm_size;
+  ctx->hash_args = hash_args;
+  ctx->delta_seed = delta_seed;
+  fpc32_context_reset_state(ctx);
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_init_default(
+  fpc32_context_ptr_t ctx,
+  uint32_t* FPC_RESTRICT fcm,
+  uint32_t* FPC_RESTRICT dfcm,
+  size_t fcm_size,
+  size_t dfcm_size)
+{
+  const fpc_hash_args_t hash_args = FPC32_DEFAULT_HASH_ARGS;
+  fpc32_context_init(ctx, fcm, dfcm, fcm_size, dfcm_size, hash_args, 0.0F);
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_reset(
+  fpc32_context_ptr_t ctx)
+{
+  FPC_MEMSET(ctx->fcm, 0, ctx->fcm_size * sizeof(uint32_t));
+  FPC_MEMSET(ctx->dfcm, 0, ctx->dfcm_size * sizeof(uint32_t));
+  fpc32_context_reset_state(ctx);
+}
+
+#ifndef FPC_NO_ALLOCATOR
+
+// Contexts handed out by fpc32_context_create. The link is used by context pools.
+typedef struct fpc32_context_node_t
+{
+  fpc32_context_t ctx;
+  struct fpc32_context_node_t* next;
+} fpc32_context_node_t;
+
+FPC_ATTR fpc32_context_t* FPC_CALL fpc32_context_create(
+  size_t fcm_size,
+  size_t dfcm_size)
+{
+  fpc32_context_node_t* node;
+  uint32_t* fcm;
+  uint32_t* dfcm;
+  node = (fpc32_context_node_t*)FPC_REALLOC(NULL, sizeof(fpc32_context_node_t));
+  fcm = (uint32_t*)fpc_table_alloc(fcm_size * sizeof(uint32_t));
+  dfcm = (uint32_t*)fpc_table_alloc(dfcm_size * sizeof(uint32_t));
+  if (node == NULL || fcm == NULL || dfcm == NULL)
+  {
+    fpc_table_free(fcm, fcm_size * sizeof(uint32_t));
+    fpc_table_free(dfcm, dfcm_size * sizeof(uint32_t));
+    FPC_FREE(node);
+    return NULL;
+  }
+  fpc32_context_init_default(&node->ctx, fcm, dfcm, fcm_size, dfcm_size);
+  fpc32_context_reset_state(&node->ctx);
+  node->next = NULL;
+  return &node->ctx;
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_destroy(
+  fpc32_context_t* ctx)
+{
+  if (ctx == NULL)
+    return;
+  fpc_table_free(ctx->fcm, ctx->fcm_size * sizeof(uint32_t));
+  fpc_table_free(ctx->dfcm, ctx->dfcm_size * sizeof(uint32_t));
+  FPC_FREE((fpc32_context_node_t*)ctx);
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_pool_init(
+  fpc32_context_pool_t* pool,
+  size_t fcm_size,
+  size_t dfcm_size)
+{
+  FPC_INVARIANT(FPC_IS_POW2(fcm_size));
+  FPC_INVARIANT(FPC_IS_POW2(dfcm_size));
+  pool->fcm_size = fcm_size;
+  pool->dfcm_size = dfcm_size;
+  pool->free_list = NULL;
+  pool->lock = 0;
+}
+
+FPC_ATTR fpc32_context_t* FPC_CALL fpc32_context_pool_acquire(
+  fpc32_context_pool_t* pool,
+  uint32_t flags)
+{
+  fpc32_context_node_t* node;
+  fpc_spin_lock(&pool->lock);
+  node = (fpc32_context_node_t*)pool->free_list;
+  if (node != NULL)
+    pool->free_list = node->next;
+  FPC_SPIN_UNLOCK(&pool->lock);
+  if (node == NULL)
+    return fpc32_context_create(pool->fcm_size, pool->dfcm_size);
+  if ((flags & FPC_POOL_RESET) != 0)
+    fpc32_context_reset(&node->ctx);
+  return &node->ctx;
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_pool_release(
+  fpc32_context_pool_t* pool,
+  fpc32_context_t* ctx)
+{
+  fpc32_context_node_t* node = (fpc32_context_node_t*)ctx;
+  FPC_INVARIANT(ctx->fcm_size == pool->fcm_size && ctx->dfcm_size == pool->dfcm_size);
+  fpc_spin_lock(&pool->lock);
+  node->next = (fpc32_context_node_t*)pool->free_list;
+  pool->free_list = node;
+  FPC_SPIN_UNLOCK(&pool->lock);
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_pool_destroy(
+  fpc32_context_pool_t* pool)
+{
+  fpc32_context_node_t* node;
+  fpc32_context_node_t* next;
+  for (node = (fpc32_context_node_t*)pool->free_list; node != NULL; node = next)
+  {
+    next = node->next;
+    fpc32_context_destroy(&node->ctx);
+  }
+  pool->free_list = NULL;
+}
+
+#endif
+
+/*
+  Packed checkpoint tables: one header byte per pair of entries, each nibble holding the
+  number of bytes of "entry ^ previous nonzero entry" that follow, or FPC_CHECKPOINT_ZERO.
+*/
+
+static void fpc32_copy_le(
+  void* FPC_RESTRICT out,
+  const void* FPC_RESTRICT in,
+  size_t count)
+{
+#ifdef FPC_SWAP_STREAM
+  uint32_t value;
+  size_t i;
+  for (i = 0; i != count; ++i)
+  {
+    FPC_MEMCPY(&value, (const uint8_t* FPC_RESTRICT)in + i * sizeof(uint32_t), sizeof(uint32_t));
+    value = FPC_BSWAP32(value);
+    FPC_MEMCPY((uint8_t* FPC_RESTRICT)out + i * sizeof(uint32_t), &value, sizeof(uint32_t));
+  }
+#else
+  FPC_MEMCPY(out, in, count * sizeof(uint32_t));
+#endif
+}
+
+static uint8_t* fpc32_checkpoint_pack(
+  const uint32_t* FPC_RESTRICT table,
+  size_t size,
+  uint8_t* FPC_RESTRICT out)
+{
+  uint8_t* FPC_RESTRICT out_h;
+  const uint32_t* FPC_RESTRICT const end = table + size;
+  uint32_t value, value_xor, base;
+  uint_fast8_t header, length, i;
+  base = 0;
+  while (table != end)
+  {
+    out_h = out;
+    ++out;
+    header = 0;
+    for (i = 0; i != 2 && table != end; ++i)
+    {
+      value = *table;
+      ++table;
+      if (value == 0)
+      {
+        header |= FPC_CHECKPOINT_ZERO << (i << 2);
+        continue;
+      }
+      value_xor = value ^ base;
+      base = value;
+      length = 4 - FPC_LZBC32(value_xor);
+      FPC_INVARIANT(length <= 4);
+      value_xor = FPC_LE32(value_xor);
+      FPC_MEMCPY(out, &value_xor, length);
+      out += length;
+      header |= length << (i << 2);
+    }
+    *out_h = header;
+  }
+  return out;
+}
+
+static const uint8_t* fpc32_checkpoint_unpack(
+  uint32_t* FPC_RESTRICT table,
+  size_t size,
+  const uint8_t* FPC_RESTRICT in,
+  const uint8_t* FPC_RESTRICT in_end)
+{
+  uint32_t value, base;
+  size_t j;
+  uint_fast8_t header, length, i;
+  base = 0;
+  for (j = 0; j != size;)
+  {
+    if (in == in_end)
+      return NULL;
+    header = *in;
+    ++in;
+    for (i = 0; i != 2 && j != size; ++i, ++j)
+    {
+      length = header & 15;
+      header >>= 4;
+      value = 0;
+      if (length != FPC_CHECKPOINT_ZERO)
+      {
+        if (length > sizeof(value) || (size_t)(in_end - in) < length)
+          return NULL;
+        FPC_MEMCPY(&value, in, length);
+        in += length;
+        value = FPC_LE32(value);
+        value ^= base;
+        base = value;
+      }
+      if (table != NULL)
+        table[j] = value;
+    }
+  }
+  return in;
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_context_save(
+  fpc32_context_ptr_t ctx,
+  uint32_t flags,
+  void* FPC_RESTRICT out)
+{
+  uint8_t* FPC_RESTRICT out_b;
+  uint32_t state[5];
+  out_b = (uint8_t* FPC_RESTRICT)out;
+  out_b[0] = FPC_CHECKPOINT_VERSION;
+  out_b[1] = (uint8_t)(flags & FPC_CHECKPOINT_COMPRESS);
+  out_b[2] = (uint8_t)FPC_CTZ64((uint64_t)ctx->fcm_size);
+  out_b[3] = (uint8_t)FPC_CTZ64((uint64_t)ctx->dfcm_size);
+  out_b[4] = ctx->hash_args.fcm_lshift;
+  out_b[5] = ctx->hash_args.fcm_rshift;
+  out_b[6] = ctx->hash_args.dfcm_lshift;
+  out_b[7] = ctx->hash_args.dfcm_rshift;
+  state[0] = FPC_LE32(ctx->fcm_hash);
+  state[1] = FPC_LE32(ctx->dfcm_hash);
+  state[2] = FPC_LE32(ctx->fcm_prediction);
+  state[3] = FPC_LE32(ctx->dfcm_prediction);
+  state[4] = FPC_LE32(ctx->last);
+  FPC_MEMCPY(out_b + 8, state, sizeof(state));
+  out_b += 28;
+  if (flags & FPC_CHECKPOINT_COMPRESS)
+  {
+    out_b = fpc32_checkpoint_pack(ctx->fcm, ctx->fcm_size, out_b);
+    out_b = fpc32_checkpoint_pack(ctx->dfcm, ctx->dfcm_size, out_b);
+  }
+  else
+  {
+    fpc32_copy_le(out_b, ctx->fcm, ctx->fcm_size);
+    out_b += ctx->fcm_size * sizeof(uint32_t);
+    fpc32_copy_le(out_b, ctx->dfcm, ctx->dfcm_size);
+    out_b += ctx->dfcm_size * sizeof(uint32_t);
+  }
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_context_load(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  size_t in_size)
+{
+  const uint8_t* FPC_RESTRICT in_b;
+  const uint8_t* FPC_RESTRICT in_end;
+  const uint8_t* FPC_RESTRICT tables;
+  const uint8_t* FPC_RESTRICT end;
+  uint32_t state[5];
+  in_b = (const uint8_t* FPC_RESTRICT)in;
+  in_end = in_b + in_size;
+  if (in_size < 28 ||
+    in_b[0] != FPC_CHECKPOINT_VERSION ||
+    in_b[2] >= sizeof(size_t) * 8 || ((size_t)1 << in_b[2]) != ctx->fcm_size ||
+    in_b[3] >= sizeof(size_t) * 8 || ((size_t)1 << in_b[3]) != ctx->dfcm_size ||
+    in_b[4] >= 32 || in_b[5] >= 32 ||
+    in_b[6] >= 32 || in_b[7] >= 32)
+    return 0;
+  FPC_MEMCPY(state, in_b + 8, sizeof(state));
+  // The hashes index the tables before they are masked again.
+  if (FPC_LE32(state[0]) >= ctx->fcm_size || FPC_LE32(state[1]) >= ctx->dfcm_size)
+    return 0;
+  tables = in_b + 28;
+  // Find the end of the tables before anything in "ctx" is overwritten.
+  if (in_b[1] & FPC_CHECKPOINT_COMPRESS)
+  {
+    end = fpc32_checkpoint_unpack(NULL, ctx->fcm_size, tables, in_end);
+    if (end != NULL)
+      end = fpc32_checkpoint_unpack(NULL, ctx->dfcm_size, end, in_end);
+    if (end == NULL)
+      return 0;
+  }
+  else
+  {
+    if ((size_t)(in_end - tables) / sizeof(uint32_t) < ctx->fcm_size + ctx->dfcm_size)
+      return 0;
+    end = tables + (ctx->fcm_size + ctx->dfcm_size) * sizeof(uint32_t);
+  }
+  ctx->hash_args.fcm_lshift = in_b[4];
+  ctx->hash_args.fcm_rshift = in_b[5];
+  ctx->hash_args.dfcm_lshift = in_b[6];
+  ctx->hash_args.dfcm_rshift = in_b[7];
+  ctx->fcm_hash = FPC_LE32(state[0]);
+  ctx->dfcm_hash = FPC_LE32(state[1]);
+  ctx->fcm_prediction = FPC_LE32(state[2]);
+  ctx->dfcm_prediction = FPC_LE32(state[3]);
+  ctx->last = FPC_LE32(state[4]);
+  if (in_b[1] & FPC_CHECKPOINT_COMPRESS)
+  {
+    tables = fpc32_checkpoint_unpack(ctx->fcm, ctx->fcm_size, tables, end);
+    (void)fpc32_checkpoint_unpack(ctx->dfcm, ctx->dfcm_size, tables, end);
+  }
+  else
+  {
+    fpc32_copy_le(ctx->fcm, tables, ctx->fcm_size);
+    fpc32_copy_le(ctx->dfcm, tables + ctx->fcm_size * sizeof(uint32_t), ctx->dfcm_size);
+  }
+  return (size_t)(end - in_b);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_size(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const float* FPC_RESTRICT const end = in + count;
+  size_t size;
+  uint32_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last,
+    fcm_xor, dfcm_xor;
+  uint_fast8_t type, lzbc, i;
+  size = 0;
+  if (in == end)
+    return size;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  do
+  {
+    #ifdef __clang__
+      #pragma clang unroll(full)
+    #elif defined(__GNUC__)
+      #pragma GCC unroll(2)
+    #endif
+    for (i = 0; i != 2; ++i)
+    {
+      value = FPC_LOAD_NT_U32(in);
+      ++in;
+      fcm_xor = value ^ fcm_prediction;
+      dfcm_xor = value ^ dfcm_prediction;
+      type = fcm_xor > dfcm_xor;
+      value_xor = type ? dfcm_xor : fcm_xor;
+      lzbc = FPC_LZBC32(value_xor);
+      lzbc = 4 - lzbc;
+      FPC_INVARIANT(lzbc <= 4);
+      size += lzbc;
+      delta = value - last;
+      last = value;
+      ctx->fcm[fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(fcm_hash, value);
+      fcm_prediction = ctx->fcm[fcm_hash];
+      ctx->dfcm[dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+      dfcm_prediction = ctx->dfcm[dfcm_hash];
+      dfcm_prediction += value;
+      FPC_UNLIKELY_IF (in == end)
+        break;
+    }
+    ++size;
+  } while (in != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return size;
+}
+
+#ifdef FPC_STREAMING
+static size_t fpc32_encode_separate_streaming(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out_headers,
+  void* FPC_RESTRICT out_data)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const float* FPC_RESTRICT const end = in + count;
+  fpc_stream_t header_stream, data_stream;
+  uint8_t* FPC_RESTRICT header_cursor;
+  uint8_t* FPC_RESTRICT data_cursor;
+  size_t size;
+  uint8_t header_byte;
+  uint32_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last,
+    fcm_xor, dfcm_xor;
+  uint_fast8_t
+    type, lzbc,
+    header, i;
+  FPC_INVARIANT((uint8_t* FPC_RESTRICT)out_headers != (uint8_t* FPC_RESTRICT)out_data);
+  FPC_INVARIANT(
+    (uint8_t* FPC_RESTRICT)out_headers < (uint8_t* FPC_RESTRICT)out_data ||
+    (uint8_t* FPC_RESTRICT)out_headers + count >= (uint8_t* FPC_RESTRICT)out_data);
+  if (in == end)
+    return 0;
+  header_cursor = fpc_stream_init(&header_stream, out_headers);
+  data_cursor = fpc_stream_init(&data_stream, out_data);
+  size = 0;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  do
+  {
+    header = 0;
+    FPC_PREFETCH(in + FPC_PREFETCH_DISTANCE);
+    #ifdef __clang__
+      #pragma clang unroll(full)
+    #elif defined(__GNUC__)
+      #pragma GCC unroll(2)
+    #endif
+    for (i = 0; i != 2; ++i)
+    {
+      value = FPC_LOAD_NT_U32(in);
+      ++in;
+      fcm_xor = value ^ fcm_prediction;
+      dfcm_xor = value ^ dfcm_prediction;
+      type = fcm_xor > dfcm_xor;
+      value_xor = type ? dfcm_xor : fcm_xor;
+      lzbc = FPC_LZBC32(value_xor);
+      header |= (((type << 3) | lzbc)) << (i << 2);
+      lzbc = 4 - lzbc;
+      FPC_INVARIANT(lzbc <= 4);
+      value_xor = FPC_LE32(value_xor);
+      data_cursor = fpc_stream_write(&data_stream, data_cursor, &value_xor, sizeof(value_xor), lzbc);
+      size += lzbc;
+      delta = value - last;
+      last = value;
+      ctx->fcm[fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(fcm_hash, value);
+      fcm_prediction = ctx->fcm[fcm_hash];
+      ctx->dfcm[dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+      dfcm_prediction = ctx->dfcm[dfcm_hash];
+      dfcm_prediction += value;
+      FPC_UNLIKELY_IF (in == end)
+        break;
+    }
+    header_byte = (uint8_t)header;
+    header_cursor = fpc_stream_write(&header_stream, header_cursor, &header_byte, 1, 1);
+  } while (in != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  fpc_stream_finish(&header_stream, header_cursor);
+  fpc_stream_finish(&data_stream, data_cursor);
+  return size + (count + 1) / 2;
+}
+#endif
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_separate(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out_headers,
+  void* FPC_RESTRICT out_data)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const float* FPC_RESTRICT const end = in + count;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint8_t* FPC_RESTRICT out_h;
+  uint32_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last,
+    fcm_xor, dfcm_xor;
+  uint_fast8_t
+    type, lzbc,
+    header, i;
+#ifdef FPC_STREAMING
+  if (count >= FPC_STREAMING_MIN_SIZE / sizeof(uint32_t))
+    return fpc32_encode_separate_streaming(ctx, in, count, out_headers, out_data);
+#endif
+  FPC_INVARIANT((uint8_t* FPC_RESTRICT)out_headers != (uint8_t* FPC_RESTRICT)out_data);
+  FPC_INVARIANT(
+    (uint8_t* FPC_RESTRICT)out_headers < (uint8_t* FPC_RESTRICT)out_data ||
+    (uint8_t* FPC_RESTRICT)out_headers + count >= (uint8_t* FPC_RESTRICT)out_data);
+  if (in == end)
+    return 0;
+  out_h = (uint8_t * FPC_RESTRICT)out_headers;
+  out_begin = out_b = (uint8_t* FPC_RESTRICT)out_data;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  do
+  {
+    header = 0;
+    #ifdef __clang__
+      #pragma clang unroll(full)
+    #elif defined(__GNUC__)
+      #pragma GCC unroll(2)
+    #endif
+    for (i = 0; i != 2; ++i)
+    {
+      value = FPC_LOAD_NT_U32(in);
+      ++in;
+      fcm_xor = value ^ fcm_prediction;
+      dfcm_xor = value ^ dfcm_prediction;
+      type = fcm_xor > dfcm_xor;
+      value_xor = type ? dfcm_xor : fcm_xor;
+      lzbc = FPC_LZBC32(value_xor);
+      header |= (((type << 3) | lzbc)) << (i << 2);
+      lzbc = 4 - lzbc;
+      FPC_INVARIANT(lzbc <= 4);
+      value_xor = FPC_LE32(value_xor);
+      FPC_MEMCPY(out_b, &value_xor, lzbc);
+      out_b += lzbc;
+      delta = value - last;
+      last = value;
+      ctx->fcm[fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(fcm_hash, value);
+      fcm_prediction = ctx->fcm[fcm_hash];
+      ctx->dfcm[dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+      dfcm_prediction = ctx->dfcm[dfcm_hash];
+      dfcm_prediction += value;
+      FPC_UNLIKELY_IF (in == end)
+        break;
+    }
+    *out_h = header;
+    ++out_h;
+  } while (in != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(out_b - out_begin) + (count + 1) / 2;
+}
+
+#ifdef FPC_STREAMING
+static size_t fpc32_decode_separate_streaming(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT headers,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  float* FPC_RESTRICT const end = out + out_count;
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const uint8_t* FPC_RESTRICT in_data;
+  const uint8_t* FPC_RESTRICT in_h;
+  fpc_stream_t out_stream;
+  uint8_t* FPC_RESTRICT out_cursor;
+  uint32_t
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last,
+    value;
+  uint_fast8_t
+    type, lzbc,
+    header, i;
+  if (out == end)
+    return 0;
+  out_cursor = fpc_stream_init(&out_stream, out);
+  in_data = (const uint8_t* FPC_RESTRICT)in;
+  in_h = (const uint8_t* FPC_RESTRICT)headers;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  do
+  {
+    header = *in_h;
+    ++in_h;
+    FPC_PREFETCH(in_data + FPC_PREFETCH_DISTANCE * sizeof(value));
+    #ifdef __clang__
+      #pragma clang unroll(full)
+    #elif defined(__GNUC__)
+      #pragma GCC unroll(2)
+    #endif
+    for (i = 0; i != 2; ++i)
+    {
+      type = header & 8;
+      lzbc = (header & 7);
+      lzbc = 4 - lzbc;
+      header >>= 4;
+      value = 0;
+      FPC_MEMCPY(&value, in_data, lzbc);
+      value = FPC_LE32(value);
+      value ^= type ? dfcm_prediction : fcm_prediction;
+      out_cursor = fpc_stream_write(&out_stream, out_cursor, &value, sizeof(value), sizeof(value));
+      ++out;
+      in_data += lzbc;
+      delta = value - last;
+      last = value;
+      ctx->fcm[fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(fcm_hash, value);
+      fcm_prediction = ctx->fcm[fcm_hash];
+      ctx->dfcm[dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+      dfcm_prediction = ctx->dfcm[dfcm_hash];
+      dfcm_prediction += value;
+      FPC_UNLIKELY_IF (out == end)
+        break;
+    }
+  } while (out != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  fpc_stream_finish(&out_stream, out_cursor);
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in) + (out_count + 1) / 2;
+}
+#endif
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_separate(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT headers,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  float* FPC_RESTRICT const end = out + out_count;
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const uint8_t* FPC_RESTRICT in_data;
+  const uint8_t* FPC_RESTRICT in_h;
+  uint32_t
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last,
+    value;
+  uint_fast8_t
+    type, lzbc,
+    header, i;
+#ifdef FPC_STREAMING
+  if (out_count >= FPC_STREAMING_MIN_SIZE / sizeof(uint32_t))
+    return fpc32_decode_separate_streaming(ctx, headers, in, out, out_count);
+#endif
+  if (out == end)
+    return 0;
+  in_data = (const uint8_t* FPC_RESTRICT)in;
+  in_h = (const uint8_t* FPC_RESTRICT)headers;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  do
+  {
+    header = *in_h;
+    ++in_h;
+    #ifdef __clang__
+      #pragma clang unroll(full)
+    #elif defined(__GNUC__)
+      #pragma GCC unroll(2)
+    #endif
+    for (i = 0; i != 2; ++i)
+    {
+      type = header & 8;
+      lzbc = (header & 7);
+      lzbc = 4 - lzbc;
+      header >>= 4;
+      value = 0;
+      FPC_MEMCPY(&value, in_data, lzbc);
+      value = FPC_LE32(value);
+      value ^= type ? dfcm_prediction : fcm_prediction;
+      FPC_STORE_NT_U32(out, value);
+      ++out;
+      in_data += lzbc;
+      delta = value - last;
+      last = value;
+      ctx->fcm[fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(fcm_hash, value);
+      fcm_prediction = ctx->fcm[fcm_hash];
+      ctx->dfcm[dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+      dfcm_prediction = ctx->dfcm[dfcm_hash];
+      dfcm_prediction += value;
+      FPC_UNLIKELY_IF (out == end)
+        break;
+    }
+  } while (out != end);
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in) + (out_count + 1) / 2;
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  return fpc32_encode_separate(
+    ctx,
+    in,
+    count,
+    out,
+    (uint8_t* FPC_RESTRICT)out + FPC32_UPPER_BOUND_METADATA(count));
+}
+
+/*
+  Block trial encoding. The FCM and DFCM hashes only depend on the input values, so the
+  table slots a block is going to overwrite can be recorded before encoding it, and put
+  back if the block ends up being stored raw. Slots are restored in reverse order, so logs
+  recorded while encoding, which may hold the same slot more than once, work as well.
+*/
+
+typedef struct fpc32_block_undo_t
+{
+  size_t fcm_index[FPC_BLOCK_COUNT];
+  size_t dfcm_index[FPC_BLOCK_COUNT];
+  uint32_t fcm[FPC_BLOCK_COUNT];
+  uint32_t dfcm[FPC_BLOCK_COUNT];
+  uint32_t fcm_hash;
+  uint32_t dfcm_hash;
+  uint32_t fcm_prediction;
+  uint32_t dfcm_prediction;
+  uint32_t last;
+} fpc32_block_undo_t;
+
+static void fpc32_block_snapshot(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  fpc32_block_undo_t* FPC_RESTRICT undo)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint32_t value, delta, last, fcm_hash, dfcm_hash;
+  size_t i;
+  FPC_INVARIANT(count <= FPC_BLOCK_COUNT);
+  undo->fcm_hash = fcm_hash = ctx->fcm_hash;
+  undo->dfcm_hash = dfcm_hash = ctx->dfcm_hash;
+  undo->fcm_prediction = ctx->fcm_prediction;
+  undo->dfcm_prediction = ctx->dfcm_prediction;
+  undo->last = last = ctx->last;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U32(in + i);
+    delta = value - last;
+    last = value;
+    undo->fcm_index[i] = (size_t)fcm_hash;
+    undo->fcm[i] = ctx->fcm[fcm_hash];
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    undo->dfcm_index[i] = (size_t)dfcm_hash;
+    undo->dfcm[i] = ctx->dfcm[dfcm_hash];
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+  }
+}
+
+static void fpc32_block_rollback(
+  fpc32_context_ptr_t ctx,
+  size_t count,
+  uint_fast8_t marker,
+  const fpc32_block_undo_t* FPC_RESTRICT undo)
+{
+  size_t i;
+  if (marker != FPC_BLOCK_DFCM)
+  {
+    for (i = count; i != 0; --i)
+      ctx->fcm[undo->fcm_index[i - 1]] = undo->fcm[i - 1];
+  }
+  if (marker != FPC_BLOCK_FCM)
+  {
+    for (i = count; i != 0; --i)
+      ctx->dfcm[undo->dfcm_index[i - 1]] = undo->dfcm[i - 1];
+  }
+  ctx->fcm_hash = undo->fcm_hash;
+  ctx->dfcm_hash = undo->dfcm_hash;
+  ctx->fcm_prediction = undo->fcm_prediction;
+  ctx->dfcm_prediction = undo->dfcm_prediction;
+  ctx->last = undo->last;
+}
+
+/*
+  Fast profile: blocks run a single predictor, chosen from the leading zero bytes it
+  would have produced over the first FPC_FAST_SAMPLE_COUNT values of the block, read
+  without updating the tables. With no type bit, every header nibble is a plain leading
+  zero byte count.
+*/
+
+static uint_fast8_t fpc32_block_choose(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint32_t value, delta, last, fcm_hash, dfcm_hash;
+  size_t i, fcm_score, dfcm_score;
+  if (count > FPC_FAST_SAMPLE_COUNT)
+    count = FPC_FAST_SAMPLE_COUNT;
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  last = ctx->last;
+  fcm_score = dfcm_score = 0;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U32(in + i);
+    fcm_score += FPC_LZBC32(value ^ ctx->fcm[fcm_hash]);
+    dfcm_score += FPC_LZBC32(value ^ (uint32_t)(ctx->dfcm[dfcm_hash] + last));
+    delta = value - last;
+    last = value;
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+  }
+  return dfcm_score > fcm_score ? FPC_BLOCK_DFCM : FPC_BLOCK_FCM;
+}
+
+static size_t fpc32_block_encode_fast(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  uint_fast8_t marker,
+  void* FPC_RESTRICT out,
+  fpc32_block_undo_t* FPC_RESTRICT undo)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const float* FPC_RESTRICT const end = in + count;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_b;
+  size_t j;
+  uint32_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    prediction, delta, last;
+  uint_fast8_t lzbc, header, i;
+  FPC_INVARIANT(count != 0 && count <= FPC_BLOCK_COUNT);
+  out_h = (uint8_t* FPC_RESTRICT)out;
+  out_b = out_h + FPC32_UPPER_BOUND_METADATA(count);
+  undo->fcm_hash = fcm_hash = ctx->fcm_hash;
+  undo->dfcm_hash = dfcm_hash = ctx->dfcm_hash;
+  undo->fcm_prediction = ctx->fcm_prediction;
+  undo->dfcm_prediction = ctx->dfcm_prediction;
+  undo->last = last = ctx->last;
+  j = 0;
+  if (marker == FPC_BLOCK_FCM)
+  {
+    prediction = ctx->fcm[fcm_hash];
+    do
+    {
+      header = 0;
+      for (i = 0; i != 2; ++i)
+      {
+        value = FPC_LOAD_NT_U32(in);
+        ++in;
+        value_xor = value ^ prediction;
+        lzbc = FPC_LZBC32(value_xor);
+        header |= lzbc << (i << 2);
+        value_xor = FPC_LE32(value_xor);
+        FPC_MEMCPY(out_b, &value_xor, 4 - lzbc);
+        out_b += 4 - lzbc;
+        last = value;
+        undo->fcm_index[j] = (size_t)fcm_hash;
+        undo->fcm[j] = ctx->fcm[fcm_hash];
+        ++j;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        prediction = ctx->fcm[fcm_hash];
+        FPC_UNLIKELY_IF (in == end)
+          break;
+      }
+      *out_h = header;
+      ++out_h;
+    } while (in != end);
+    ctx->fcm_prediction = prediction;
+  }
+  else
+  {
+    prediction = ctx->dfcm[dfcm_hash] + last;
+    do
+    {
+      header = 0;
+      for (i = 0; i != 2; ++i)
+      {
+        value = FPC_LOAD_NT_U32(in);
+        ++in;
+        value_xor = value ^ prediction;
+        lzbc = FPC_LZBC32(value_xor);
+        header |= lzbc << (i << 2);
+        value_xor = FPC_LE32(value_xor);
+        FPC_MEMCPY(out_b, &value_xor, 4 - lzbc);
+        out_b += 4 - lzbc;
+        delta = value - last;
+        last = value;
+        undo->dfcm_index[j] = (size_t)dfcm_hash;
+        undo->dfcm[j] = ctx->dfcm[dfcm_hash];
+        ++j;
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        prediction = ctx->dfcm[dfcm_hash] + value;
+        FPC_UNLIKELY_IF (in == end)
+          break;
+      }
+      *out_h = header;
+      ++out_h;
+    } while (in != end);
+    ctx->dfcm_prediction = prediction;
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->last = last;
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+static size_t fpc32_block_decode_fast(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count,
+  uint_fast8_t marker)
+{
+  float* FPC_RESTRICT const end = out + out_count;
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const uint8_t* FPC_RESTRICT in_data;
+  const uint8_t* FPC_RESTRICT in_h;
+  uint32_t
+    fcm_hash, dfcm_hash,
+    prediction, delta, last,
+    value;
+  uint_fast8_t lzbc, header, i;
+  FPC_INVARIANT(out_count != 0);
+  in_h = (const uint8_t* FPC_RESTRICT)in;
+  in_data = in_h + FPC32_UPPER_BOUND_METADATA(out_count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  last = ctx->last;
+  if (marker == FPC_BLOCK_FCM)
+  {
+    prediction = ctx->fcm[fcm_hash];
+    do
+    {
+      header = *in_h;
+      ++in_h;
+      for (i = 0; i != 2; ++i)
+      {
+        lzbc = 4 - (header & 15);
+        header >>= 4;
+        value = 0;
+        FPC_MEMCPY(&value, in_data, lzbc);
+        value = FPC_LE32(value);
+        value ^= prediction;
+        FPC_STORE_NT_U32(out, value);
+        ++out;
+        in_data += lzbc;
+        last = value;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        prediction = ctx->fcm[fcm_hash];
+        FPC_UNLIKELY_IF (out == end)
+          break;
+      }
+    } while (out != end);
+    ctx->fcm_prediction = prediction;
+  }
+  else
+  {
+    prediction = ctx->dfcm[dfcm_hash] + last;
+    do
+    {
+      header = *in_h;
+      ++in_h;
+      for (i = 0; i != 2; ++i)
+      {
+        lzbc = 4 - (header & 15);
+        header >>= 4;
+        value = 0;
+        FPC_MEMCPY(&value, in_data, lzbc);
+        value = FPC_LE32(value);
+        value ^= prediction;
+        FPC_STORE_NT_U32(out, value);
+        ++out;
+        in_data += lzbc;
+        delta = value - last;
+        last = value;
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        prediction = ctx->dfcm[dfcm_hash] + value;
+        FPC_UNLIKELY_IF (out == end)
+          break;
+      }
+    } while (out != end);
+    ctx->dfcm_prediction = prediction;
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+static size_t fpc32_block_trial(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  FPC_BOOL fast,
+  uint8_t* FPC_RESTRICT out,
+  fpc32_block_undo_t* FPC_RESTRICT undo,
+  uint_fast8_t* FPC_RESTRICT marker)
+{
+  if (fast)
+  {
+    *marker = fpc32_block_choose(ctx, in, count);
+    return fpc32_block_encode_fast(ctx, in, count, *marker, out, undo);
+  }
+  *marker = FPC_BLOCK_FPC;
+  fpc32_block_snapshot(ctx, in, count, undo);
+  return fpc32_encode(ctx, in, count, out);
+}
+
+static size_t fpc32_encode_blocks_profile(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out,
+  FPC_BOOL fast,
+  FPC_BOOL adaptive,
+  size_t restart_count)
+{
+  fpc32_block_undo_t undo;
+  uint8_t scratch[FPC32_UPPER_BOUND(FPC_BLOCK_COUNT)];
+  uint8_t* FPC_RESTRICT out_b;
+  size_t offset, step, raw_size, size, average, since_change, since_restart, seed_budget;
+  uint_fast8_t marker, flags;
+  out_b = (uint8_t* FPC_RESTRICT)out;
+  average = since_change = since_restart = 0;
+  // The tables may not know the data yet, as after a regime change.
+  seed_budget = ctx->fcm_size;
+  for (offset = 0; offset != count; offset += step)
+  {
+    step = count - offset;
+    if (step > FPC_BLOCK_COUNT)
+      step = FPC_BLOCK_COUNT;
+    raw_size = step * sizeof(uint32_t);
+    flags = 0;
+    FPC_UNLIKELY_IF (restart_count != 0 && since_restart >= restart_count * 2)
+    {
+      fpc32_context_reset(ctx);
+      flags = FPC_BLOCK_RESET;
+      since_restart = 0;
+    }
+    size = fpc32_block_trial(ctx, in + offset, step, fast, scratch, &undo, &marker);
+    if (adaptive)
+    {
+      FPC_UNLIKELY_IF (since_change >= FPC_ADAPTIVE_MIN_BLOCKS && FPC_ADAPTIVE_JUMPED(size, average >> FPC_ADAPTIVE_AVERAGE_SHIFT, raw_size))
+      {
+        // New regime: a good place for a restart point, and the tables have to learn it.
+        if (restart_count != 0 && since_restart >= restart_count && flags == 0)
+        {
+          fpc32_block_rollback(ctx, step, marker, &undo);
+          fpc32_context_reset(ctx);
+          flags = FPC_BLOCK_RESET;
+          since_restart = 0;
+          size = fpc32_block_trial(ctx, in + offset, step, fast, scratch, &undo, &marker);
+        }
+        seed_budget = ctx->fcm_size;
+        since_change = 0;
+      }
+      if (since_change == 0)
+        average = size << FPC_ADAPTIVE_AVERAGE_SHIFT;
+      average += size - (average >> FPC_ADAPTIVE_AVERAGE_SHIFT);
+      ++since_change;
+    }
+    since_restart += step;
+    if (size + (raw_size >> FPC_BLOCK_MIN_GAIN_SHIFT) > raw_size)
+    {
+      if (adaptive && seed_budget >= step)
+      {
+        // Keep the updates, so data that comes back later in the regime is predicted.
+        flags |= FPC_BLOCK_SEED;
+        seed_budget -= step;
+      }
+      else
+      {
+        fpc32_block_rollback(ctx, step, marker, &undo);
+      }
+      *out_b = (uint8_t)(FPC_BLOCK_RAW | flags);
+      ++out_b;
+      fpc32_copy_le(out_b, in + offset, step);
+      out_b += raw_size;
+    }
+    else
+    {
+      *out_b = (uint8_t)(marker | flags);
+      ++out_b;
+      FPC_MEMCPY(out_b, scratch, size);
+      out_b += size;
+    }
+  }
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_blocks(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  return fpc32_encode_blocks_profile(ctx, in, count, out, 0, 0, 0);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_blocks_fast(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  return fpc32_encode_blocks_profile(ctx, in, count, out, 1, 0, 0);
+}
+
+static size_t fpc32_block_size(
+  const uint8_t* FPC_RESTRICT in,
+  size_t count,
+  uint_fast8_t marker)
+{
+  size_t size, i;
+  uint_fast8_t lzbc;
+  if (marker == FPC_BLOCK_RAW)
+    return count * sizeof(uint32_t);
+  size = FPC32_UPPER_BOUND_METADATA(count);
+  for (i = 0; i != count; ++i)
+  {
+    lzbc = (in[i >> 1] >> ((i & 1) << 2)) & 15;
+    if (marker == FPC_BLOCK_FPC)
+      lzbc &= 7;
+    size += 4 - lzbc;
+  }
+  return size;
+}
+
+static size_t fpc32_decode_blocks_profile(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  const uint8_t* FPC_RESTRICT in_b;
+  size_t offset, step;
+  uint_fast8_t marker;
+  in_b = (const uint8_t* FPC_RESTRICT)in;
+  for (offset = 0; offset != out_count; offset += step)
+  {
+    step = out_count - offset;
+    if (step > FPC_BLOCK_COUNT)
+      step = FPC_BLOCK_COUNT;
+    marker = *in_b;
+    ++in_b;
+    FPC_UNLIKELY_IF ((marker & FPC_BLOCK_RESET) != 0)
+    {
+      fpc32_context_reset(ctx);
+      marker &= ~FPC_BLOCK_RESET;
+    }
+    FPC_LIKELY_IF (marker == FPC_BLOCK_FPC)
+    {
+      in_b += fpc32_decode(ctx, in_b, out + offset, step);
+    }
+    else if (marker == FPC_BLOCK_RAW)
+    {
+      fpc32_copy_le(out + offset, in_b, step);
+      in_b += step * sizeof(uint32_t);
+    }
+    else if (marker == (FPC_BLOCK_RAW | FPC_BLOCK_SEED))
+    {
+      fpc32_copy_le(out + offset, in_b, step);
+      in_b += step * sizeof(uint32_t);
+      (void)fpc32_encode_size(ctx, out + offset, step);
+    }
+    else
+    {
+      FPC_INVARIANT(marker == FPC_BLOCK_FCM || marker == FPC_BLOCK_DFCM);
+      in_b += fpc32_block_decode_fast(ctx, in_b, out + offset, step, marker);
+    }
+  }
+  return (size_t)(in_b - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_blocks(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  return fpc32_decode_blocks_profile(ctx, in, out, out_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_blocks_adaptive(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  size_t restart_count,
+  void* FPC_RESTRICT out)
+{
+  return fpc32_encode_blocks_profile(ctx, in, count, out, 0, 1, restart_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_blocks_adaptive(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  return fpc32_decode_blocks_profile(ctx, in, out, out_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_blocks_find_restart(
+  const void* FPC_RESTRICT in,
+  size_t count,
+  size_t index,
+  size_t* FPC_RESTRICT restart_index)
+{
+  const uint8_t* FPC_RESTRICT in_b;
+  size_t offset, step, restart;
+  uint_fast8_t marker;
+  in_b = (const uint8_t* FPC_RESTRICT)in;
+  restart = 0;
+  *restart_index = 0;
+  for (offset = 0; offset < count && offset <= index; offset += step)
+  {
+    step = count - offset;
+    if (step > FPC_BLOCK_COUNT)
+      step = FPC_BLOCK_COUNT;
+    marker = *in_b;
+    if ((marker & FPC_BLOCK_RESET) != 0)
+    {
+      restart = (size_t)(in_b - (const uint8_t* FPC_RESTRICT)in);
+      *restart_index = offset;
+    }
+    ++in_b;
+    in_b += fpc32_block_size(in_b, step, marker & ~(FPC_BLOCK_RESET | FPC_BLOCK_SEED));
+  }
+  return restart;
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_buffer(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  fpc_buffer_t* FPC_RESTRICT out)
+{
+  const size_t header_size = FPC32_UPPER_BOUND_METADATA(count);
+  size_t offset, step, data_size;
+  uint8_t* FPC_RESTRICT base;
+  data_size = 0;
+  for (offset = 0; offset != count; offset += step)
+  {
+    step = count - offset;
+    if (step > FPC_BUFFER_STEP_COUNT)
+      step = FPC_BUFFER_STEP_COUNT;
+    if (!fpc_buffer_reserve(out, out->size + header_size + data_size + FPC32_UPPER_BOUND_DATA(step)))
+      return FPC_BUFFER_ERROR;
+    base = (uint8_t* FPC_RESTRICT)out->data + out->size;
+    data_size += fpc32_encode_separate(
+      ctx,
+      in + offset,
+      step,
+      base + offset / 2,
+      base + header_size + data_size) - (step + 1) / 2;
+  }
+  out->size += header_size + data_size;
+  return header_size + data_size;
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  return fpc32_decode_separate(
+    ctx,
+    in,
+    (const uint8_t* FPC_RESTRICT)in + FPC32_UPPER_BOUND_METADATA(out_count),
+    out,
+    out_count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_channels(
+  fpc32_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const float* FPC_RESTRICT in,
+  size_t frames,
+  void* FPC_RESTRICT out)
+{
+  const size_t count = frames * nchannels;
+  fpc32_context_t* FPC_RESTRICT ctx;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint32_t
+    value, value_xor,
+    delta,
+    fcm_xor, dfcm_xor;
+  uint_fast8_t
+    type, lzbc,
+    header;
+  size_t fcm_mod_mask, dfcm_mod_mask, frame, channel, i;
+  if (count == 0)
+    return 0;
+  out_h = (uint8_t* FPC_RESTRICT)out;
+  out_begin = out_b = out_h + FPC32_UPPER_BOUND_METADATA(count);
+  header = 0;
+  i = 0;
+  for (frame = 0; frame != frames; ++frame)
+  {
+    // Channels only share the output, so their dependency chains overlap.
+    for (channel = 0; channel != nchannels; ++channel, ++i)
+    {
+      ctx = ctxs + channel;
+      fcm_mod_mask = ctx->fcm_size - 1;
+      dfcm_mod_mask = ctx->dfcm_size - 1;
+      value = FPC_LOAD_NT_U32(in + i);
+      fcm_xor = value ^ ctx->fcm_prediction;
+      dfcm_xor = value ^ ctx->dfcm_prediction;
+      type = fcm_xor > dfcm_xor;
+      value_xor = type ? dfcm_xor : fcm_xor;
+      lzbc = FPC_LZBC32(value_xor);
+      header |= (((type << 3) | lzbc)) << ((i & 1) << 2);
+      lzbc = 4 - lzbc;
+      FPC_INVARIANT(lzbc <= 4);
+      value_xor = FPC_LE32(value_xor);
+      FPC_MEMCPY(out_b, &value_xor, lzbc);
+      out_b += lzbc;
+      if ((i & 1) == 1)
+      {
+        *out_h = (uint8_t)header;
+        ++out_h;
+        header = 0;
+      }
+      delta = value - ctx->last;
+      ctx->last = value;
+      ctx->fcm[ctx->fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(ctx->fcm_hash, value);
+      ctx->fcm_prediction = ctx->fcm[ctx->fcm_hash];
+      ctx->dfcm[ctx->dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(ctx->dfcm_hash, delta);
+      ctx->dfcm_prediction = ctx->dfcm[ctx->dfcm_hash] + value;
+    }
+  }
+  if ((count & 1) != 0)
+    *out_h = (uint8_t)header;
+  return (size_t)(out_b - out_begin) + FPC32_UPPER_BOUND_METADATA(count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_channels(
+  fpc32_context_t* FPC_RESTRICT ctxs,
+  size_t nchannels,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t frames)
+{
+  const size_t count = frames * nchannels;
+  fpc32_context_t* FPC_RESTRICT ctx;
+  const uint8_t* FPC_RESTRICT in_h;
+  const uint8_t* FPC_RESTRICT in_data;
+  uint32_t value, delta;
+  uint_fast8_t
+    type, lzbc,
+    header;
+  size_t fcm_mod_mask, dfcm_mod_mask, frame, channel, i;
+  if (count == 0)
+    return 0;
+  in_h = (const uint8_t* FPC_RESTRICT)in;
+  in_data = in_h + FPC32_UPPER_BOUND_METADATA(count);
+  header = 0;
+  i = 0;
+  for (frame = 0; frame != frames; ++frame)
+  {
+    for (channel = 0; channel != nchannels; ++channel, ++i)
+    {
+      ctx = ctxs + channel;
+      fcm_mod_mask = ctx->fcm_size - 1;
+      dfcm_mod_mask = ctx->dfcm_size - 1;
+      if ((i & 1) == 0)
+      {
+        header = *in_h;
+        ++in_h;
+      }
+      type = header & 8;
+      lzbc = (header & 7);
+      lzbc = 4 - lzbc;
+      header >>= 4;
+      value = 0;
+      FPC_MEMCPY(&value, in_data, lzbc);
+      value = FPC_LE32(value);
+      value ^= type ? ctx->dfcm_prediction : ctx->fcm_prediction;
+      FPC_STORE_NT_U32(out + i, value);
+      in_data += lzbc;
+      delta = value - ctx->last;
+      ctx->last = value;
+      ctx->fcm[ctx->fcm_hash] = value;
+      FPC_FCM_HASH_UPDATE(ctx->fcm_hash, value);
+      ctx->fcm_prediction = ctx->fcm[ctx->fcm_hash];
+      ctx->dfcm[ctx->dfcm_hash] = delta;
+      FPC_DFCM_HASH_UPDATE(ctx->dfcm_hash, delta);
+      ctx->dfcm_prediction = ctx->dfcm[ctx->dfcm_hash] + value;
+    }
+  }
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR void FPC_CALL fpc32_estimate(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  double sample_fraction,
+  fpc_estimate_t* FPC_RESTRICT est)
+{
+  fpc32_block_undo_t undo;
+  uint8_t encoded[FPC32_UPPER_BOUND(FPC_BLOCK_COUNT)];
+  float decoded[FPC_BLOCK_COUNT];
+  double ratio, ratio_sum, ratio_square_sum, start;
+  size_t i, windows, raw_windows, stride, window, warmup, offset, size, raw_size;
+  FPC_MEMSET(est, 0, sizeof(fpc_estimate_t));
+  if (count == 0)
+    return;
+  fpc32_context_reset(ctx);
+  windows = fpc_estimate_window_count(count, sample_fraction);
+  stride = count / windows;
+  window = stride < FPC_BLOCK_COUNT ? stride : FPC_BLOCK_COUNT;
+  raw_size = window * sizeof(float);
+  ratio_sum = ratio_square_sum = 0.0;
+  raw_windows = 0;
+  for (i = 0; i != windows; ++i)
+  {
+    // Each window sits at the end of its stride, after its warm-up values.
+    offset = i * stride + stride - window;
+    warmup = offset - i * stride;
+    if (warmup > FPC_ESTIMATE_WARMUP_COUNT)
+      warmup = FPC_ESTIMATE_WARMUP_COUNT;
+    (void)fpc32_encode_size(ctx, in + offset - warmup, warmup);
+    fpc32_block_snapshot(ctx, in + offset, window, &undo);
+    start = fpc_clock_ns();
+    size = fpc32_encode(ctx, in + offset, window, encoded);
+    est->encode_ns += fpc_clock_ns() - start;
+    fpc32_block_rollback(ctx, window, FPC_BLOCK_FPC, &undo);
+    start = fpc_clock_ns();
+    (void)fpc32_decode(ctx, encoded, decoded, window);
+    est->decode_ns += fpc_clock_ns() - start;
+    ratio = (double)size / (double)raw_size;
+    ratio_sum += ratio;
+    ratio_square_sum += ratio * ratio;
+    if (size + (raw_size >> FPC_BLOCK_MIN_GAIN_SHIFT) > raw_size)
+      ++raw_windows;
+    est->sampled_count += warmup + window;
+  }
+  fpc_estimate_finish(est, ratio_sum, ratio_square_sum, windows, raw_windows, windows * window);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_ref(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  const float* FPC_RESTRICT ref,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint8_t* FPC_RESTRICT out_t;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint32_t
+    value, value_xor, reference,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last, ref_delta,
+    candidate_xor;
+  uint_fast8_t
+    type, lzbc,
+    types, header;
+  size_t i;
+  if (count == 0)
+    return 0;
+  out_t = (uint8_t* FPC_RESTRICT)out;
+  out_h = out_t + FPC_REF_TYPES_SIZE(count);
+  out_begin = out_b = out_h + FPC32_UPPER_BOUND_METADATA(count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  ref_delta = 0;
+  types = header = 0;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U32(in + i);
+    reference = FPC_LOAD_NT_U32(ref + i);
+    type = FPC_REF_FCM;
+    value_xor = value ^ fcm_prediction;
+    candidate_xor = value ^ dfcm_prediction;
+    if (candidate_xor < value_xor)
+    {
+      type = FPC_REF_DFCM;
+      value_xor = candidate_xor;
+    }
+    candidate_xor = value ^ reference;
+    if (candidate_xor < value_xor)
+    {
+      type = FPC_REF_SNAPSHOT;
+      value_xor = candidate_xor;
+    }
+    candidate_xor = value ^ (reference + ref_delta);
+    if (candidate_xor < value_xor)
+    {
+      type = FPC_REF_SNAPSHOT_DELTA;
+      value_xor = candidate_xor;
+    }
+    lzbc = FPC_LZBC32(value_xor);
+    types |= type << ((i & 3) << 1);
+    header |= lzbc << ((i & 1) << 2);
+    if ((i & 3) == 3)
+    {
+      *out_t = (uint8_t)types;
+      ++out_t;
+      types = 0;
+    }
+    if ((i & 1) == 1)
+    {
+      *out_h = (uint8_t)header;
+      ++out_h;
+      header = 0;
+    }
+    value_xor = FPC_LE32(value_xor);
+    FPC_MEMCPY(out_b, &value_xor, 4 - lzbc);
+    out_b += 4 - lzbc;
+    ref_delta = value - reference;
+    delta = value - last;
+    last = value;
+    ctx->fcm[fcm_hash] = value;
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    fcm_prediction = ctx->fcm[fcm_hash];
+    ctx->dfcm[dfcm_hash] = delta;
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+    dfcm_prediction = ctx->dfcm[dfcm_hash];
+    dfcm_prediction += value;
+  }
+  if ((count & 3) != 0)
+    *out_t = (uint8_t)types;
+  if ((count & 1) != 0)
+    *out_h = (uint8_t)header;
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(out_b - out_begin) + FPC_REF_TYPES_SIZE(count) + FPC32_UPPER_BOUND_METADATA(count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_ref(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const float* FPC_RESTRICT ref,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  const uint8_t* FPC_RESTRICT in_t;
+  const uint8_t* FPC_RESTRICT in_h;
+  const uint8_t* FPC_RESTRICT in_data;
+  uint32_t
+    value, reference, prediction,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last, ref_delta;
+  uint_fast8_t type, lzbc;
+  size_t i;
+  if (out_count == 0)
+    return 0;
+  in_t = (const uint8_t* FPC_RESTRICT)in;
+  in_h = in_t + FPC_REF_TYPES_SIZE(out_count);
+  in_data = in_h + FPC32_UPPER_BOUND_METADATA(out_count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  ref_delta = 0;
+  for (i = 0; i != out_count; ++i)
+  {
+    type = (in_t[i >> 2] >> ((i & 3) << 1)) & 3;
+    lzbc = 4 - ((in_h[i >> 1] >> ((i & 1) << 2)) & 15);
+    reference = FPC_LOAD_NT_U32(ref + i);
+    switch (type)
+    {
+    case FPC_REF_FCM:
+      prediction = fcm_prediction;
+      break;
+    case FPC_REF_DFCM:
+      prediction = dfcm_prediction;
+      break;
+    case FPC_REF_SNAPSHOT:
+      prediction = reference;
+      break;
+    default:
+      prediction = reference + ref_delta;
+      break;
+    }
+    value = 0;
+    FPC_MEMCPY(&value, in_data, lzbc);
+    value = FPC_LE32(value);
+    value ^= prediction;
+    FPC_STORE_NT_U32(out + i, value);
+    in_data += lzbc;
+    ref_delta = value - reference;
+    delta = value - last;
+    last = value;
+    ctx->fcm[fcm_hash] = value;
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    fcm_prediction = ctx->fcm[fcm_hash];
+    ctx->dfcm[dfcm_hash] = delta;
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+    dfcm_prediction = ctx->dfcm[dfcm_hash];
+    dfcm_prediction += value;
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+// Returns the bit pattern of the prediction, with every NaN mapped to FPC_GRID_NAN32, since
+// the sign and payload of a NaN produced by an operation differ between platforms.
+static FPC_INLINE uint32_t fpc32_grid_lorenzo(
+  const float* FPC_RESTRICT p,
+  size_t row,
+  size_t plane,
+  FPC_BOOL has_x,
+  FPC_BOOL has_y,
+  FPC_BOOL has_z)
+{
+  float prediction = 0;
+  uint32_t bits;
+  if (has_x)
+    prediction = FPC_GRID_ROUND32(prediction + p[-1]);
+  if (has_y)
+  {
+    prediction = FPC_GRID_ROUND32(prediction + *(p - row));
+    if (has_x)
+      prediction = FPC_GRID_ROUND32(prediction - *(p - row - 1));
+  }
+  if (has_z)
+  {
+    prediction = FPC_GRID_ROUND32(prediction + *(p - plane));
+    if (has_x)
+      prediction = FPC_GRID_ROUND32(prediction - *(p - plane - 1));
+    if (has_y)
+    {
+      prediction = FPC_GRID_ROUND32(prediction - *(p - plane - row));
+      if (has_x)
+        prediction = FPC_GRID_ROUND32(prediction + *(p - plane - row - 1));
+    }
+  }
+  FPC_MEMCPY(&bits, &prediction, sizeof(bits));
+  if ((uint32_t)(bits << 1) > (uint32_t)(FPC_GRID_INF32 << 1))
+    bits = FPC_GRID_NAN32;
+  return bits;
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_grid_tile(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile_index,
+  void* FPC_RESTRICT out)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  fpc_grid_tile_t tile;
+  const float* FPC_RESTRICT row;
+  uint8_t* FPC_RESTRICT out_t;
+  uint8_t* FPC_RESTRICT out_h;
+  uint8_t* FPC_RESTRICT out_begin;
+  uint8_t* FPC_RESTRICT out_b;
+  uint32_t
+    value, value_xor,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    lorenzo_prediction,
+    delta, last,
+    candidate_xor;
+  uint_fast8_t
+    type, lzbc,
+    types, header;
+  size_t i, x, y, z, plane;
+  fpc_grid_tile_init(&tile, dims, ndims, tile_index);
+  plane = tile.size[0] * tile.size[1];
+  out_t = (uint8_t* FPC_RESTRICT)out;
+  out_h = out_t + FPC_REF_TYPES_SIZE(tile.count);
+  out_begin = out_b = out_h + FPC32_UPPER_BOUND_METADATA(tile.count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  types = header = 0;
+  i = 0;
+  for (z = 0; z != tile.extent[2]; ++z)
+  {
+    for (y = 0; y != tile.extent[1]; ++y)
+    {
+      row = in + (tile.origin[2] + z) * plane + (tile.origin[1] + y) * tile.size[0] + tile.origin[0];
+      for (x = 0; x != tile.extent[0]; ++x, ++i)
+      {
+        lorenzo_prediction = fpc32_grid_lorenzo(row + x, tile.size[0], plane, x != 0, y != 0, z != 0);
+        FPC_MEMCPY(&value, row + x, sizeof(value));
+        type = FPC_GRID_FCM;
+        value_xor = value ^ fcm_prediction;
+        candidate_xor = value ^ dfcm_prediction;
+        if (candidate_xor < value_xor)
+        {
+          type = FPC_GRID_DFCM;
+          value_xor = candidate_xor;
+        }
+        candidate_xor = value ^ lorenzo_prediction;
+        if (candidate_xor < value_xor)
+        {
+          type = FPC_GRID_LORENZO;
+          value_xor = candidate_xor;
+        }
+        lzbc = FPC_LZBC32(value_xor);
+        types |= type << ((i & 3) << 1);
+        header |= lzbc << ((i & 1) << 2);
+        if ((i & 3) == 3)
+        {
+          *out_t = (uint8_t)types;
+          ++out_t;
+          types = 0;
+        }
+        if ((i & 1) == 1)
+        {
+          *out_h = (uint8_t)header;
+          ++out_h;
+          header = 0;
+        }
+        value_xor = FPC_LE32(value_xor);
+        FPC_MEMCPY(out_b, &value_xor, 4 - lzbc);
+        out_b += 4 - lzbc;
+        delta = value - last;
+        last = value;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        fcm_prediction = ctx->fcm[fcm_hash];
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        dfcm_prediction = ctx->dfcm[dfcm_hash];
+        dfcm_prediction += value;
+      }
+    }
+  }
+  if ((tile.count & 3) != 0)
+    *out_t = (uint8_t)types;
+  if ((tile.count & 1) != 0)
+    *out_h = (uint8_t)header;
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(out_b - out_begin) + FPC_REF_TYPES_SIZE(tile.count) + FPC32_UPPER_BOUND_METADATA(tile.count);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_grid_tile(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  size_t tile_index,
+  float* FPC_RESTRICT out)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  fpc_grid_tile_t tile;
+  float* FPC_RESTRICT row;
+  const uint8_t* FPC_RESTRICT in_t;
+  const uint8_t* FPC_RESTRICT in_h;
+  const uint8_t* FPC_RESTRICT in_data;
+  uint32_t
+    value, prediction,
+    fcm_hash, dfcm_hash,
+    fcm_prediction, dfcm_prediction,
+    delta, last;
+  uint_fast8_t type, lzbc;
+  size_t i, x, y, z, plane;
+  fpc_grid_tile_init(&tile, dims, ndims, tile_index);
+  plane = tile.size[0] * tile.size[1];
+  in_t = (const uint8_t* FPC_RESTRICT)in;
+  in_h = in_t + FPC_REF_TYPES_SIZE(tile.count);
+  in_data = in_h + FPC32_UPPER_BOUND_METADATA(tile.count);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  fcm_prediction = ctx->fcm_prediction;
+  dfcm_prediction = ctx->dfcm_prediction;
+  last = ctx->last;
+  i = 0;
+  for (z = 0; z != tile.extent[2]; ++z)
+  {
+    for (y = 0; y != tile.extent[1]; ++y)
+    {
+      row = out + (tile.origin[2] + z) * plane + (tile.origin[1] + y) * tile.size[0] + tile.origin[0];
+      for (x = 0; x != tile.extent[0]; ++x, ++i)
+      {
+        type = (in_t[i >> 2] >> ((i & 3) << 1)) & 3;
+        lzbc = 4 - ((in_h[i >> 1] >> ((i & 1) << 2)) & 15);
+        if (type == FPC_GRID_FCM)
+        {
+          prediction = fcm_prediction;
+        }
+        else if (type == FPC_GRID_DFCM)
+        {
+          prediction = dfcm_prediction;
+        }
+        else
+        {
+          prediction = fpc32_grid_lorenzo(row + x, tile.size[0], plane, x != 0, y != 0, z != 0);
+        }
+        value = 0;
+        FPC_MEMCPY(&value, in_data, lzbc);
+        value = FPC_LE32(value);
+        value ^= prediction;
+        FPC_MEMCPY(row + x, &value, sizeof(value));
+        in_data += lzbc;
+        delta = value - last;
+        last = value;
+        ctx->fcm[fcm_hash] = value;
+        FPC_FCM_HASH_UPDATE(fcm_hash, value);
+        fcm_prediction = ctx->fcm[fcm_hash];
+        ctx->dfcm[dfcm_hash] = delta;
+        FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+        dfcm_prediction = ctx->dfcm[dfcm_hash];
+        dfcm_prediction += value;
+      }
+    }
+  }
+  ctx->fcm_hash = fcm_hash;
+  ctx->dfcm_hash = dfcm_hash;
+  ctx->fcm_prediction = fcm_prediction;
+  ctx->dfcm_prediction = dfcm_prediction;
+  ctx->last = last;
+  return (size_t)(in_data - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_grid(
+  fpc32_context_ptr_t ctx,
+  const float* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  void* FPC_RESTRICT out)
+{
+  uint8_t* FPC_RESTRICT out_b = (uint8_t* FPC_RESTRICT)out;
+  size_t i, tile_count;
+  tile_count = fpc_grid_tile_count(dims, ndims);
+  for (i = 0; i != tile_count; ++i)
+    out_b += fpc32_encode_grid_tile(ctx, in, dims, ndims, i, out_b);
+  return (size_t)(out_b - (uint8_t* FPC_RESTRICT)out);
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_grid(
+  fpc32_context_ptr_t ctx,
+  const void* FPC_RESTRICT in,
+  const size_t* FPC_RESTRICT dims,
+  size_t ndims,
+  float* FPC_RESTRICT out)
+{
+  const uint8_t* FPC_RESTRICT in_b = (const uint8_t* FPC_RESTRICT)in;
+  size_t i, tile_count;
+  tile_count = fpc_grid_tile_count(dims, ndims);
+  for (i = 0; i != tile_count; ++i)
+    in_b += fpc32_decode_grid_tile(ctx, in_b, dims, ndims, i, out);
+  return (size_t)(in_b - (const uint8_t* FPC_RESTRICT)in);
+}
+
+FPC_ATTR void FPC_CALL fpc32_dictionary_train(
+  fpc32_context_ptr_t ctx,
+  const float* const* FPC_RESTRICT samples,
+  const size_t* FPC_RESTRICT sample_counts,
+  size_t sample_count)
+{
+  size_t i;
+  fpc32_context_reset(ctx);
+  for (i = 0; i != sample_count; ++i)
+  {
+    fpc32_context_reset_state(ctx);
+    (void)fpc32_encode_size(ctx, samples[i], sample_counts[i]);
+  }
+  fpc32_context_reset_state(ctx);
+}
+
+FPC_ATTR void FPC_CALL fpc32_context_load_dictionary(
+  fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict)
+{
+  FPC_INVARIANT(ctx->fcm_size == dict->fcm_size);
+  FPC_INVARIANT(ctx->dfcm_size == dict->dfcm_size);
+  FPC_MEMCPY(ctx->fcm, dict->fcm, ctx->fcm_size * sizeof(uint32_t));
+  FPC_MEMCPY(ctx->dfcm, dict->dfcm, ctx->dfcm_size * sizeof(uint32_t));
+  fpc32_context_reset_state(ctx);
+}
+
+static void fpc32_dictionary_restore(
+  fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict,
+  const float* FPC_RESTRICT values,
+  size_t count)
+{
+  const size_t fcm_mod_mask = ctx->fcm_size - 1;
+  const size_t dfcm_mod_mask = ctx->dfcm_size - 1;
+  uint32_t value, delta, last, fcm_hash, dfcm_hash;
+  size_t i;
+  fpc32_context_reset_state(ctx);
+  fcm_hash = ctx->fcm_hash;
+  dfcm_hash = ctx->dfcm_hash;
+  last = ctx->last;
+  for (i = 0; i != count; ++i)
+  {
+    value = FPC_LOAD_NT_U32(values + i);
+    delta = value - last;
+    last = value;
+    ctx->fcm[fcm_hash] = dict->fcm[fcm_hash];
+    FPC_FCM_HASH_UPDATE(fcm_hash, value);
+    ctx->dfcm[dfcm_hash] = dict->dfcm[dfcm_hash];
+    FPC_DFCM_HASH_UPDATE(dfcm_hash, delta);
+  }
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_encode_dictionary(
+  fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict,
+  const float* FPC_RESTRICT in,
+  size_t count,
+  void* FPC_RESTRICT out)
+{
+  uint32_t id;
+  size_t size;
+  id = FPC_LE32(dict->id);
+  FPC_MEMCPY(out, &id, FPC_DICTIONARY_HEADER_SIZE);
+  fpc32_context_reset_state(ctx);
+  size = fpc32_encode(ctx, in, count, (uint8_t* FPC_RESTRICT)out + FPC_DICTIONARY_HEADER_SIZE);
+  fpc32_dictionary_restore(ctx, dict, in, count);
+  return FPC_DICTIONARY_HEADER_SIZE + size;
+}
+
+FPC_ATTR size_t FPC_CALL fpc32_decode_dictionary(
+  fpc32_context_ptr_t ctx,
+  const fpc32_dictionary_t* FPC_RESTRICT dict,
+  const void* FPC_RESTRICT in,
+  float* FPC_RESTRICT out,
+  size_t out_count)
+{
+  size_t size;
+  if (fpc_dictionary_id(in) != dict->id)
+    return 0;
+  fpc32_context_reset_state(ctx);
+  size = fpc32_decode(ctx, (const uint8_t* FPC_RESTRICT)in + FPC_DICTIONARY_HEADER_SIZE, out, out_count);
+  fpc32_dictionary_restore(ctx, dict, out, out_count);
+  return FPC_DICTIONARY_HEADER_SIZE + size;
+}
+
 #endif
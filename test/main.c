@@ -3,6 +3,7 @@
 #define FPC_DEBUG
 #include "fpc.h"
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -84,11 +85,807 @@ void test32()
   printf("32-bit test succeeded (%llu doubles, %f compression ratio)\n", (unsigned long long)VALUE_COUNT, (double)encoded_size / (double)source_size);
 }
 
+void* FPC_CALL failing_realloc(void* user_data, void* block, size_t size)
+{
+  (void)user_data;
+  (void)block;
+  (void)size;
+  return NULL;
+}
+
+void test_buffer()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  fpc_buffer_t b;
+  size_t encoded_size, buffer_size, size_f64, capacity_f64;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  memset(&b, 0, sizeof(b));
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode(&c, source_f64, VALUE_COUNT - 1, encoded_f64);
+
+  fpc_context_reset(&c);
+  buffer_size = fpc_encode_buffer(&c, source_f64, VALUE_COUNT - 1, &b);
+
+  assert(buffer_size == encoded_size);
+  assert(b.size == buffer_size);
+  assert(memcmp(b.data, encoded_f64, buffer_size) == 0);
+  size_f64 = b.size;
+  capacity_f64 = b.capacity;
+  free(b.data);
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  memset(&b, 0, sizeof(b));
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode(&c32, source_f32, VALUE_COUNT - 1, encoded_f32);
+
+  fpc32_context_reset(&c32);
+  buffer_size = fpc32_encode_buffer(&c32, source_f32, VALUE_COUNT - 1, &b);
+
+  assert(buffer_size == encoded_size);
+  assert(b.size == buffer_size);
+  assert(memcmp(b.data, encoded_f32, buffer_size) == 0);
+  free(b.data);
+
+  // Allocation failures are told apart from empty inputs.
+  memset(&b, 0, sizeof(b));
+  b.realloc_fn = failing_realloc;
+  fpc_context_reset(&c);
+  buffer_size = fpc_encode_buffer(&c, source_f64, VALUE_COUNT, &b);
+  assert(buffer_size == FPC_BUFFER_ERROR);
+  assert(b.size == 0);
+  buffer_size = fpc_encode_buffer(&c, source_f64, 0, &b);
+  assert(buffer_size == 0);
+  (void)encoded_size;
+  (void)buffer_size;
+
+  printf("buffer test succeeded (%llu bytes, %llu byte capacity)\n",
+    (unsigned long long)size_f64, (unsigned long long)capacity_f64);
+}
+
+uint8_t encoded_blocks_f64[FPC_BLOCK_UPPER_BOUND(VALUE_COUNT)];
+uint8_t encoded_blocks_f32[FPC32_BLOCK_UPPER_BOUND(VALUE_COUNT)];
+
+void test_blocks()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  size_t i, encoded_size, decoded_size;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+
+  // Alternate between smooth and noisy stretches of data.
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f64[i] = (i / 100000) % 2 ? (double)rand() / (double)rand() : (double)(i % 1000) * 0.5;
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_blocks(&c, source_f64, VALUE_COUNT, encoded_blocks_f64);
+  assert(encoded_size <= FPC_BLOCK_UPPER_BOUND(VALUE_COUNT));
+
+  fpc_context_reset(&c);
+  decoded_size = fpc_decode_blocks(&c, encoded_blocks_f64, decoded_f64, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+  (void)decoded_size;
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("block test succeeded (%f compression ratio)\n", (double)encoded_size / (double)(VALUE_COUNT * sizeof(double)));
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_blocks_fast(&c, source_f64, VALUE_COUNT, encoded_blocks_f64);
+  assert(encoded_size <= FPC_BLOCK_UPPER_BOUND(VALUE_COUNT));
+
+  fpc_context_reset(&c);
+  decoded_size = fpc_decode_blocks(&c, encoded_blocks_f64, decoded_f64, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("fast block test succeeded (%f compression ratio)\n", (double)encoded_size / (double)(VALUE_COUNT * sizeof(double)));
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f32[i] = (float)source_f64[i];
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode_blocks(&c32, source_f32, VALUE_COUNT, encoded_blocks_f32);
+  assert(encoded_size <= FPC32_BLOCK_UPPER_BOUND(VALUE_COUNT));
+
+  fpc32_context_reset(&c32);
+  decoded_size = fpc32_decode_blocks(&c32, encoded_blocks_f32, decoded_f32, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode_blocks_fast(&c32, source_f32, VALUE_COUNT, encoded_blocks_f32);
+  assert(encoded_size <= FPC32_BLOCK_UPPER_BOUND(VALUE_COUNT));
+
+  fpc32_context_reset(&c32);
+  decoded_size = fpc32_decode_blocks(&c32, encoded_blocks_f32, decoded_f32, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  printf("32-bit block tests succeeded (%f compression ratio with the fast profile)\n", (double)encoded_size / (double)(VALUE_COUNT * sizeof(float)));
+}
+
+uint8_t checkpoint[FPC_CHECKPOINT_UPPER_BOUND(FCM_SIZE, DFCM_SIZE)];
+uint8_t checkpoint_f32[FPC32_CHECKPOINT_UPPER_BOUND(FCM_SIZE, DFCM_SIZE)];
+
+void test_checkpoint()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  size_t i, head_size, tail_size, checkpoint_size, raw_checkpoint_size, load_size, checkpoint_size_f32;
+  const size_t head_count = VALUE_COUNT / 3;
+  const size_t tail_count = VALUE_COUNT - head_count;
+  uint8_t* tail;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+
+  fpc_context_reset(&c);
+  head_size = fpc_encode(&c, source_f64, head_count, encoded_f64);
+  raw_checkpoint_size = fpc_context_save(&c, 0, checkpoint);
+  checkpoint_size = fpc_context_save(&c, FPC_CHECKPOINT_COMPRESS, checkpoint);
+
+  fpc_context_reset(&c);
+  load_size = fpc_context_load(&c, checkpoint, sizeof(checkpoint));
+  assert(load_size == checkpoint_size);
+  tail = encoded_f64 + FPC_UPPER_BOUND(head_count);
+  tail_size = fpc_encode(&c, source_f64 + head_count, tail_count, tail);
+
+  fpc_context_reset(&c);
+  fpc_decode(&c, encoded_f64, decoded_f64, head_count);
+  fpc_decode(&c, tail, decoded_f64 + head_count, tail_count);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  // Truncated checkpoints and length nibbles past the width of an entry are rejected.
+  load_size = fpc_context_load(&c, checkpoint, checkpoint_size - 1);
+  assert(load_size == 0);
+  checkpoint[48] = 0xEE;
+  load_size = fpc_context_load(&c, checkpoint, sizeof(checkpoint));
+  assert(load_size == 0);
+
+  // A shift past the width of the hashed values is rejected.
+  checkpoint[5] = 64;
+  load_size = fpc_context_load(&c, checkpoint, sizeof(checkpoint));
+  assert(load_size == 0);
+
+  // The same split through 32-bit checkpoints, uncompressed this time.
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+
+  fpc32_context_reset(&c32);
+  fpc32_encode(&c32, source_f32, head_count, encoded_f32);
+  checkpoint_size_f32 = fpc32_context_save(&c32, 0, checkpoint_f32);
+  assert(checkpoint_size_f32 <= sizeof(checkpoint_f32));
+
+  fpc32_context_reset(&c32);
+  load_size = fpc32_context_load(&c32, checkpoint_f32, checkpoint_size_f32 - 1);
+  assert(load_size == 0);
+  load_size = fpc32_context_load(&c32, checkpoint_f32, checkpoint_size_f32);
+  assert(load_size == checkpoint_size_f32);
+  tail = encoded_f32 + FPC32_UPPER_BOUND(head_count);
+  fpc32_encode(&c32, source_f32 + head_count, tail_count, tail);
+
+  fpc32_context_reset(&c32);
+  fpc32_decode(&c32, encoded_f32, decoded_f32, head_count);
+  fpc32_decode(&c32, tail, decoded_f32 + head_count, tail_count);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  // 32-bit hashes only take shifts below 32.
+  checkpoint_f32[4] = 32;
+  load_size = fpc32_context_load(&c32, checkpoint_f32, sizeof(checkpoint_f32));
+  assert(load_size == 0);
+  (void)load_size;
+
+  printf("checkpoint test succeeded (%llu + %llu bytes, %llu byte checkpoint, %llu uncompressed)\n",
+    (unsigned long long)head_size, (unsigned long long)tail_size,
+    (unsigned long long)checkpoint_size, (unsigned long long)raw_checkpoint_size);
+}
+
+#define MESSAGE_COUNT 256
+#define MESSAGE_SIZE 200
+#define SCHEMA_COUNT 4
+
+uint64_t work_fcm_f64[FCM_SIZE];
+uint64_t work_dfcm_f64[DFCM_SIZE];
+uint32_t work_fcm_f32[FCM_SIZE];
+uint32_t work_dfcm_f32[DFCM_SIZE];
+
+void make_message(double* out, size_t message)
+{
+  size_t i;
+  const size_t schema = message % SCHEMA_COUNT;
+  for (i = 0; i != MESSAGE_SIZE; ++i)
+  {
+    if (i % 8 == 0)
+      out[i] = (double)(rand() % 16);
+    else if (i % 8 == 1)
+      out[i] = (double)message * 0.25;
+    else
+      out[i] = (double)(schema * MESSAGE_SIZE + i) * 1.1;
+  }
+}
+
+void test_dictionary()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  fpc_dictionary_t d;
+  fpc32_dictionary_t d32;
+  size_t i, j, plain_size, dictionary_size, read_size, message_size;
+  const double* samples[SCHEMA_COUNT * 4];
+  const float* samples_f32[SCHEMA_COUNT * 4];
+  size_t sample_counts[SCHEMA_COUNT * 4];
+  double* const message = source_f64;
+  float* const message_f32 = source_f32;
+  const unsigned seed = (unsigned)rand();
+
+  for (i = 0; i != SCHEMA_COUNT * 4; ++i)
+  {
+    make_message(source_f64 + MESSAGE_SIZE * (i + 1), i);
+    samples[i] = source_f64 + MESSAGE_SIZE * (i + 1);
+    samples_f32[i] = source_f32 + MESSAGE_SIZE * (i + 1);
+    sample_counts[i] = MESSAGE_SIZE;
+    for (j = 0; j != MESSAGE_SIZE; ++j)
+      source_f32[MESSAGE_SIZE * (i + 1) + j] = (float)samples[i][j];
+  }
+
+  // Plain encoding goes first, since the dictionary messages share the working tables.
+  fpc_context_init_default(&c, work_fcm_f64, work_dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  plain_size = 0;
+  srand(seed);
+  for (i = 0; i != MESSAGE_COUNT; ++i)
+  {
+    make_message(message, i + 1000);
+    fpc_context_reset(&c);
+    plain_size += fpc_encode(&c, message, MESSAGE_SIZE, encoded_f64);
+  }
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  fpc_dictionary_train(&c, samples, sample_counts, SCHEMA_COUNT * 4);
+  d.fcm = fcm_f64;
+  d.dfcm = dfcm_f64;
+  d.fcm_size = FCM_SIZE;
+  d.dfcm_size = DFCM_SIZE;
+  d.id = 0xF9C0D1C7;
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  fpc32_dictionary_train(&c32, samples_f32, sample_counts, SCHEMA_COUNT * 4);
+  d32.fcm = fcm_f32;
+  d32.dfcm = dfcm_f32;
+  d32.fcm_size = FCM_SIZE;
+  d32.dfcm_size = DFCM_SIZE;
+  d32.id = 0xF9C0D1C8;
+
+  fpc_context_init_default(&c, work_fcm_f64, work_dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  fpc_context_load_dictionary(&c, &d);
+  fpc32_context_init_default(&c32, work_fcm_f32, work_dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  fpc32_context_load_dictionary(&c32, &d32);
+  dictionary_size = 0;
+  srand(seed);
+  for (i = 0; i != MESSAGE_COUNT; ++i)
+  {
+    make_message(message, i + 1000);
+
+    message_size = fpc_encode_dictionary(&c, &d, message, MESSAGE_SIZE, encoded_f64);
+    dictionary_size += message_size;
+    assert(fpc_dictionary_id(encoded_f64) == d.id);
+    read_size = fpc_decode_dictionary(&c, &d, encoded_f64, decoded_f64, MESSAGE_SIZE);
+    assert(read_size == message_size);
+    for (j = 0; j != MESSAGE_SIZE; ++j)
+      assert(message[j] == decoded_f64[j]);
+
+    for (j = 0; j != MESSAGE_SIZE; ++j)
+      message_f32[j] = (float)message[j];
+    message_size = fpc32_encode_dictionary(&c32, &d32, message_f32, MESSAGE_SIZE, encoded_f32);
+    assert(fpc_dictionary_id(encoded_f32) == d32.id);
+    read_size = fpc32_decode_dictionary(&c32, &d32, encoded_f32, decoded_f32, MESSAGE_SIZE);
+    assert(read_size == message_size);
+    (void)read_size;
+    for (j = 0; j != MESSAGE_SIZE; ++j)
+      assert(message_f32[j] == decoded_f32[j]);
+  }
+
+  // Every message put back the slots it wrote.
+  assert(memcmp(work_fcm_f64, fcm_f64, sizeof(fcm_f64)) == 0);
+  assert(memcmp(work_dfcm_f64, dfcm_f64, sizeof(dfcm_f64)) == 0);
+  assert(memcmp(work_fcm_f32, fcm_f32, sizeof(fcm_f32)) == 0);
+  assert(memcmp(work_dfcm_f32, dfcm_f32, sizeof(dfcm_f32)) == 0);
+
+  printf("dictionary test succeeded (%f compression ratio, %f without dictionary)\n",
+    (double)dictionary_size / (double)(MESSAGE_COUNT * MESSAGE_SIZE * sizeof(double)),
+    (double)plain_size / (double)(MESSAGE_COUNT * MESSAGE_SIZE * sizeof(double)));
+}
+
+double reference_f64[VALUE_COUNT];
+float reference_f32[VALUE_COUNT];
+uint8_t encoded_ref_f64[FPC_REF_UPPER_BOUND(VALUE_COUNT)];
+uint8_t encoded_ref_f32[FPC32_REF_UPPER_BOUND(VALUE_COUNT)];
+
+void test_ref()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  size_t i, encoded_size, decoded_size, flat_size;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+
+  // Two time steps of a noisy field where only some of the values change.
+  for (i = 0; i != VALUE_COUNT; ++i)
+  {
+    reference_f64[i] = (double)rand() / (double)rand();
+    source_f64[i] = i % 8 ? reference_f64[i] : reference_f64[i] * 1.0001;
+  }
+
+  fpc_context_reset(&c);
+  flat_size = fpc_encode(&c, source_f64, VALUE_COUNT, encoded_f64);
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_ref(&c, source_f64, reference_f64, VALUE_COUNT, encoded_ref_f64);
+  assert(encoded_size <= FPC_REF_UPPER_BOUND(VALUE_COUNT));
+  assert(encoded_size < flat_size);
+
+  fpc_context_reset(&c);
+  decoded_size = fpc_decode_ref(&c, encoded_ref_f64, reference_f64, decoded_f64, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+  (void)decoded_size;
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("reference test succeeded (%f compression ratio, %f without reference)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(double)),
+    (double)flat_size / (double)(VALUE_COUNT * sizeof(double)));
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  for (i = 0; i != VALUE_COUNT; ++i)
+  {
+    reference_f32[i] = (float)reference_f64[i];
+    source_f32[i] = i % 8 ? reference_f32[i] : reference_f32[i] * 1.0001f;
+  }
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode_ref(&c32, source_f32, reference_f32, VALUE_COUNT, encoded_ref_f32);
+  assert(encoded_size <= FPC32_REF_UPPER_BOUND(VALUE_COUNT));
+
+  fpc32_context_reset(&c32);
+  decoded_size = fpc32_decode_ref(&c32, encoded_ref_f32, reference_f32, decoded_f32, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  printf("32-bit reference test succeeded (%f compression ratio)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(float)));
+}
+
+uint8_t encoded_grid_f64[FPC_GRID_UPPER_BOUND(VALUE_COUNT, VALUE_COUNT / FPC_GRID_TILE_COUNT)];
+uint8_t encoded_grid_f32[FPC32_GRID_UPPER_BOUND(VALUE_COUNT, VALUE_COUNT / FPC_GRID_TILE_COUNT)];
+
+void test_grid()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  size_t i, x, y, encoded_size, decoded_size, flat_size, tile_size, tile_count;
+  const size_t dims[2] = { 2048, 2048 };
+  const size_t partial_dims[3] = { 17, 33, 70 };
+  const size_t special_dims[2] = { 100, 130 };
+  const size_t special_count = special_dims[0] * special_dims[1];
+  uint64_t special_f64;
+  uint32_t special_f32;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+
+  // A smooth 2-D field plus a rough profile along each axis.
+  for (y = 0; y != dims[0]; ++y)
+    for (x = 0; x != dims[1]; ++x)
+      source_f64[y * dims[1] + x] =
+        sin((double)x * 0.01) * cos((double)y * 0.013) +
+        (double)((x * 7919) % 1009) * 0.001 +
+        (double)((y * 104729) % 1013) * 0.001;
+
+  fpc_context_reset(&c);
+  flat_size = fpc_encode(&c, source_f64, VALUE_COUNT, encoded_f64);
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_grid(&c, source_f64, dims, 2, encoded_grid_f64);
+  assert(encoded_size <= FPC_GRID_UPPER_BOUND(VALUE_COUNT, fpc_grid_tile_count(dims, 2)));
+  assert(encoded_size < flat_size);
+
+  fpc_context_reset(&c);
+  decoded_size = fpc_decode_grid(&c, encoded_grid_f64, dims, 2, decoded_f64);
+  assert(decoded_size == encoded_size);
+  (void)decoded_size;
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("grid test succeeded (%f compression ratio, %f as a flat array)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(double)),
+    (double)flat_size / (double)(VALUE_COUNT * sizeof(double)));
+
+  // Partial 3-D tiles, encoded and decoded independently in opposite orders.
+  tile_count = fpc_grid_tile_count(partial_dims, 3);
+  memset(decoded_f64, 0, sizeof(decoded_f64));
+  for (i = 0; i != tile_count; ++i)
+  {
+    fpc_context_reset(&c);
+    tile_size = fpc_encode_grid_tile(&c, source_f64, partial_dims, 3, i, encoded_grid_f64 + i * FPC_GRID_TILE_UPPER_BOUND);
+    assert(tile_size <= FPC_GRID_TILE_UPPER_BOUND);
+    (void)tile_size;
+  }
+  for (i = tile_count; i != 0; --i)
+  {
+    fpc_context_reset(&c);
+    fpc_decode_grid_tile(&c, encoded_grid_f64 + (i - 1) * FPC_GRID_TILE_UPPER_BOUND, partial_dims, 3, i - 1, decoded_f64);
+  }
+
+  for (i = 0; i != partial_dims[0] * partial_dims[1] * partial_dims[2]; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("grid tile test succeeded (%llu tiles)\n", (unsigned long long)tile_count);
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f32[i] = (float)source_f64[i];
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode_grid(&c32, source_f32, dims, 2, encoded_grid_f32);
+  assert(encoded_size <= FPC32_GRID_UPPER_BOUND(VALUE_COUNT, fpc_grid_tile_count(dims, 2)));
+
+  fpc32_context_reset(&c32);
+  decoded_size = fpc32_decode_grid(&c32, encoded_grid_f32, dims, 2, decoded_f32);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  memset(decoded_f32, 0, sizeof(decoded_f32));
+  for (i = 0; i != tile_count; ++i)
+  {
+    fpc32_context_reset(&c32);
+    tile_size = fpc32_encode_grid_tile(&c32, source_f32, partial_dims, 3, i, encoded_grid_f32 + i * FPC32_GRID_TILE_UPPER_BOUND);
+    assert(tile_size <= FPC32_GRID_TILE_UPPER_BOUND);
+  }
+  for (i = tile_count; i != 0; --i)
+  {
+    fpc32_context_reset(&c32);
+    fpc32_decode_grid_tile(&c32, encoded_grid_f32 + (i - 1) * FPC32_GRID_TILE_UPPER_BOUND, partial_dims, 3, i - 1, decoded_f32);
+  }
+
+  for (i = 0; i != partial_dims[0] * partial_dims[1] * partial_dims[2]; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  printf("32-bit grid tests succeeded (%f compression ratio)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(float)));
+
+  // NaNs of either sign and with payloads, and infinities, next to finite neighbours.
+  for (i = 0; i != special_count; ++i)
+  {
+    source_f64[i] = (double)(i % special_dims[1]) * 0.25 + (double)(i / special_dims[1]);
+    special_f64 = i % 3 ? (uint64_t)0x7FF0 << 48 : (uint64_t)0xFFF8 << 48 | (uint64_t)i;
+    if (i % 7 == 0)
+      memcpy(source_f64 + i, &special_f64, sizeof(special_f64));
+    else if (i % 11 == 0)
+      source_f64[i] = i % 2 ? HUGE_VAL : -HUGE_VAL;
+  }
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_grid(&c, source_f64, special_dims, 2, encoded_grid_f64);
+  fpc_context_reset(&c);
+  decoded_size = fpc_decode_grid(&c, encoded_grid_f64, special_dims, 2, decoded_f64);
+  assert(decoded_size == encoded_size);
+  assert(memcmp(source_f64, decoded_f64, special_count * sizeof(double)) == 0);
+
+  printf("grid special value test succeeded (%f compression ratio)\n",
+    (double)encoded_size / (double)(special_count * sizeof(double)));
+
+  for (i = 0; i != special_count; ++i)
+  {
+    source_f32[i] = (float)(i % special_dims[1]) * 0.25f + (float)(i / special_dims[1]);
+    special_f32 = i % 3 ? 0x7F800000U : 0xFFC00000U | (uint32_t)(i & 0x3FFFFF);
+    if (i % 7 == 0)
+      memcpy(source_f32 + i, &special_f32, sizeof(special_f32));
+    else if (i % 11 == 0)
+      source_f32[i] = i % 2 ? (float)HUGE_VAL : (float)-HUGE_VAL;
+  }
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode_grid(&c32, source_f32, special_dims, 2, encoded_grid_f32);
+  fpc32_context_reset(&c32);
+  decoded_size = fpc32_decode_grid(&c32, encoded_grid_f32, special_dims, 2, decoded_f32);
+  assert(decoded_size == encoded_size);
+  assert(memcmp(source_f32, decoded_f32, special_count * sizeof(float)) == 0);
+
+  printf("32-bit grid special value test succeeded (%f compression ratio)\n",
+    (double)encoded_size / (double)(special_count * sizeof(float)));
+}
+
+void test_pool()
+{
+  fpc_context_t c;
+  fpc_context_t* created;
+  fpc_context_t* first;
+  fpc_context_t* second;
+  fpc_context_pool_t pool;
+  size_t i, encoded_size, created_size;
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f64[i] = (double)(i % 1000) * 0.5;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode(&c, source_f64, VALUE_COUNT, encoded_f64);
+
+  // Tables large enough to be backed by huge pages.
+  created = fpc_context_create(1 << 20, 1 << 20);
+  assert(created != NULL);
+  fpc_context_destroy(created);
+
+  // Created contexts start out reset.
+  created = fpc_context_create(FCM_SIZE, DFCM_SIZE);
+  assert(created != NULL);
+  created_size = fpc_encode(created, source_f64, VALUE_COUNT, encoded_f64);
+  assert(created_size == encoded_size);
+  fpc_context_destroy(created);
+
+  fpc_context_pool_init(&pool, FCM_SIZE, DFCM_SIZE);
+  first = fpc_context_pool_acquire(&pool, 0);
+  second = fpc_context_pool_acquire(&pool, 0);
+  assert(first != NULL && second != NULL && first != second);
+  fpc_encode(first, source_f64, VALUE_COUNT, encoded_f64);
+  fpc_context_pool_release(&pool, first);
+
+  // Released contexts are handed out again, and only cleared on request.
+  created = fpc_context_pool_acquire(&pool, FPC_POOL_RESET);
+  assert(created == first);
+  for (i = 0; i != FCM_SIZE; ++i)
+    assert(first->fcm[i] == 0);
+  created_size = fpc_encode(first, source_f64, VALUE_COUNT, encoded_f64);
+  assert(created_size == encoded_size);
+  (void)created_size;
+  (void)encoded_size;
+
+  fpc_context_pool_release(&pool, first);
+  fpc_context_pool_release(&pool, second);
+  fpc_context_pool_destroy(&pool);
+
+  printf("pool test succeeded\n");
+}
+
+void test_estimate()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  fpc_estimate_t est;
+  size_t i, encoded_size;
+  double ratio;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f64[i] = (i / 100000) % 2 ? (double)rand() / (double)rand() : (double)(i % 1000) * 0.5;
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode(&c, source_f64, VALUE_COUNT, encoded_f64);
+  ratio = (double)encoded_size / (double)(VALUE_COUNT * sizeof(double));
+
+  // Sampling everything gives back the exact size, since VALUE_COUNT is a multiple of FPC_BLOCK_COUNT.
+  fpc_estimate(&c, source_f64, VALUE_COUNT, 1.0, &est);
+  assert(est.sampled_count == VALUE_COUNT);
+  assert((size_t)(est.ratio * (double)(VALUE_COUNT * sizeof(double)) + 0.5) == encoded_size);
+
+  // Fractions out of [0, 1] are clamped.
+  fpc_estimate(&c, source_f64, VALUE_COUNT, 2.0, &est);
+  assert(est.sampled_count == VALUE_COUNT);
+  fpc_estimate(&c, source_f64, VALUE_COUNT, -1.0, &est);
+  assert(est.sampled_count <= FPC_BLOCK_COUNT + FPC_ESTIMATE_WARMUP_COUNT);
+
+  fpc_estimate(&c, source_f64, VALUE_COUNT, 0.01, &est);
+  assert(est.sampled_count < VALUE_COUNT / 25);
+  assert(est.ratio_low <= est.ratio && est.ratio <= est.ratio_high);
+  assert(est.ratio > ratio - 0.05 && est.ratio < ratio + 0.05);
+  assert(est.raw_block_fraction > 0.25 && est.raw_block_fraction < 0.75);
+
+  printf("estimate test succeeded (%f estimated ratio in [%f, %f], %f actual, %f ns/value encode, %f ns/value decode)\n",
+    est.ratio, est.ratio_low, est.ratio_high, ratio, est.encode_ns, est.decode_ns);
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f32[i] = (float)source_f64[i];
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode(&c32, source_f32, VALUE_COUNT, encoded_f32);
+  ratio = (double)encoded_size / (double)(VALUE_COUNT * sizeof(float));
+
+  fpc32_estimate(&c32, source_f32, VALUE_COUNT, 1.0, &est);
+  assert(est.sampled_count == VALUE_COUNT);
+  assert((size_t)(est.ratio * (double)(VALUE_COUNT * sizeof(float)) + 0.5) == encoded_size);
+
+  fpc32_estimate(&c32, source_f32, VALUE_COUNT, 0.01, &est);
+  assert(est.ratio_low <= est.ratio && est.ratio <= est.ratio_high);
+  assert(est.ratio > ratio - 0.05 && est.ratio < ratio + 0.05);
+
+  printf("32-bit estimate test succeeded (%f estimated ratio, %f actual)\n", est.ratio, ratio);
+}
+
+#define CHANNEL_COUNT 3
+#define FRAME_COUNT (VALUE_COUNT / CHANNEL_COUNT)
+
+void test_channels()
+{
+  fpc_context_t c;
+  fpc_context_t channels[CHANNEL_COUNT];
+  fpc32_context_t channels_f32[CHANNEL_COUNT];
+  size_t i, encoded_size, decoded_size, flat_size;
+
+  // Interleaved x, y, z samples, each channel with a different pattern.
+  for (i = 0; i != FRAME_COUNT; ++i)
+  {
+    source_f64[i * CHANNEL_COUNT] = (double)(i % 1000) * 0.5;
+    source_f64[i * CHANNEL_COUNT + 1] = (double)(i % 777) * -0.25 + 1e6;
+    source_f64[i * CHANNEL_COUNT + 2] = (double)((i * 7) % 4099);
+  }
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  fpc_context_reset(&c);
+  flat_size = fpc_encode(&c, source_f64, FRAME_COUNT * CHANNEL_COUNT, encoded_f64);
+
+  // Each channel gets a quarter of the same tables.
+  for (i = 0; i != CHANNEL_COUNT; ++i)
+  {
+    fpc_context_init_default(channels + i, fcm_f64 + i * (FCM_SIZE / 4), dfcm_f64 + i * (DFCM_SIZE / 4), FCM_SIZE / 4, DFCM_SIZE / 4);
+    fpc_context_reset(channels + i);
+  }
+  encoded_size = fpc_encode_channels(channels, CHANNEL_COUNT, source_f64, FRAME_COUNT, encoded_f64);
+  assert(encoded_size <= FPC_UPPER_BOUND(FRAME_COUNT * CHANNEL_COUNT));
+  assert(encoded_size < flat_size);
+
+  for (i = 0; i != CHANNEL_COUNT; ++i)
+    fpc_context_reset(channels + i);
+  decoded_size = fpc_decode_channels(channels, CHANNEL_COUNT, encoded_f64, decoded_f64, FRAME_COUNT);
+  assert(decoded_size == encoded_size);
+  (void)decoded_size;
+
+  for (i = 0; i != FRAME_COUNT * CHANNEL_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("channel test succeeded (%f compression ratio, %f with a single context)\n",
+    (double)encoded_size / (double)(FRAME_COUNT * CHANNEL_COUNT * sizeof(double)),
+    (double)flat_size / (double)(FRAME_COUNT * CHANNEL_COUNT * sizeof(double)));
+
+  for (i = 0; i != FRAME_COUNT * CHANNEL_COUNT; ++i)
+    source_f32[i] = (float)source_f64[i];
+  for (i = 0; i != CHANNEL_COUNT; ++i)
+  {
+    fpc32_context_init_default(channels_f32 + i, fcm_f32 + i * (FCM_SIZE / 4), dfcm_f32 + i * (DFCM_SIZE / 4), FCM_SIZE / 4, DFCM_SIZE / 4);
+    fpc32_context_reset(channels_f32 + i);
+  }
+  encoded_size = fpc32_encode_channels(channels_f32, CHANNEL_COUNT, source_f32, FRAME_COUNT, encoded_f32);
+  assert(encoded_size <= FPC32_UPPER_BOUND(FRAME_COUNT * CHANNEL_COUNT));
+
+  for (i = 0; i != CHANNEL_COUNT; ++i)
+    fpc32_context_reset(channels_f32 + i);
+  decoded_size = fpc32_decode_channels(channels_f32, CHANNEL_COUNT, encoded_f32, decoded_f32, FRAME_COUNT);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != FRAME_COUNT * CHANNEL_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  printf("32-bit channel test succeeded (%f compression ratio)\n",
+    (double)encoded_size / (double)(FRAME_COUNT * CHANNEL_COUNT * sizeof(float)));
+}
+
+void test_adaptive()
+{
+  fpc_context_t c;
+  fpc32_context_t c32;
+  size_t i, encoded_size, decoded_size, plain_size, restart, restart_index;
+  double* const burst = reference_f64;
+
+  // Idle stretches between bursts that replay the same noisy waveform.
+  for (i = 0; i != 8192; ++i)
+    burst[i] = (double)rand() / (double)rand();
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f64[i] = (i / 100000) % 2 ? burst[i % 8192] : (double)(i % 1000) * 0.5;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  fpc_context_reset(&c);
+  plain_size = fpc_encode_blocks(&c, source_f64, VALUE_COUNT, encoded_blocks_f64);
+
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_blocks_adaptive(&c, source_f64, VALUE_COUNT, 0, encoded_blocks_f64);
+  assert(encoded_size <= FPC_BLOCK_UPPER_BOUND(VALUE_COUNT));
+  assert(encoded_size < plain_size);
+
+  fpc_context_reset(&c);
+  decoded_size = fpc_decode_blocks_adaptive(&c, encoded_blocks_f64, decoded_f64, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+  (void)decoded_size;
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("adaptive block test succeeded (%f compression ratio, %f without adaptation)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(double)),
+    (double)plain_size / (double)(VALUE_COUNT * sizeof(double)));
+
+  // Decode the tail from the last restart point, with a context in some other state.
+  fpc_context_reset(&c);
+  encoded_size = fpc_encode_blocks_adaptive(&c, source_f64, VALUE_COUNT, VALUE_COUNT / 8, encoded_blocks_f64);
+  restart = fpc_blocks_find_restart(encoded_blocks_f64, VALUE_COUNT, VALUE_COUNT - 1, &restart_index);
+  assert(restart != 0 && restart_index != 0 && restart_index % FPC_BLOCK_COUNT == 0);
+  assert(restart_index >= VALUE_COUNT - VALUE_COUNT / 4);
+
+  memset(decoded_f64, 0, sizeof(decoded_f64));
+  decoded_size = fpc_decode_blocks_adaptive(&c, encoded_blocks_f64 + restart, decoded_f64 + restart_index, VALUE_COUNT - restart_index);
+  assert(restart + decoded_size == encoded_size);
+
+  for (i = restart_index; i != VALUE_COUNT; ++i)
+    assert(source_f64[i] == decoded_f64[i]);
+
+  printf("adaptive restart test succeeded (%f compression ratio, last restart at %llu)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(double)), (unsigned long long)restart_index);
+
+  fpc32_context_init_default(&c32, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  for (i = 0; i != VALUE_COUNT; ++i)
+    source_f32[i] = (float)source_f64[i];
+
+  fpc32_context_reset(&c32);
+  encoded_size = fpc32_encode_blocks_adaptive(&c32, source_f32, VALUE_COUNT, VALUE_COUNT / 8, encoded_blocks_f32);
+  assert(encoded_size <= FPC32_BLOCK_UPPER_BOUND(VALUE_COUNT));
+
+  fpc32_context_reset(&c32);
+  decoded_size = fpc32_decode_blocks_adaptive(&c32, encoded_blocks_f32, decoded_f32, VALUE_COUNT);
+  assert(decoded_size == encoded_size);
+
+  for (i = 0; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  restart = fpc32_blocks_find_restart(encoded_blocks_f32, VALUE_COUNT, VALUE_COUNT - 1, &restart_index);
+  assert(restart != 0 && restart_index % FPC_BLOCK_COUNT == 0);
+
+  memset(decoded_f32, 0, sizeof(decoded_f32));
+  decoded_size = fpc32_decode_blocks_adaptive(&c32, encoded_blocks_f32 + restart, decoded_f32 + restart_index, VALUE_COUNT - restart_index);
+  assert(restart + decoded_size == encoded_size);
+
+  for (i = restart_index; i != VALUE_COUNT; ++i)
+    assert(source_f32[i] == decoded_f32[i]);
+
+  printf("32-bit adaptive block test succeeded (%f compression ratio, last restart at %llu)\n",
+    (double)encoded_size / (double)(VALUE_COUNT * sizeof(float)), (unsigned long long)restart_index);
+}
+
 int main(
   int argc,
   const char** argv)
 {
+  (void)argc;
+  (void)argv;
   test();
   test32();
+  test_buffer();
+  test_checkpoint();
+  test_dictionary();
+  test_blocks();
+  test_ref();
+  test_grid();
+  test_pool();
+  test_estimate();
+  test_channels();
+  test_adaptive();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,149 @@
+#define FPC_IMPLEMENTATION
+#define FPC_SKIP_ENDIANNESS
+#define FPC_DEBUG
+// Every call streams while "streaming_min_size" is 0 and none does while it is (size_t)-1,
+// so the streaming path is checked against the regular one in the same build.
+#define FPC_STREAMING
+#define FPC_STREAMING_MIN_SIZE streaming_min_size
+#include <stddef.h>
+size_t streaming_min_size;
+#include "fpc.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Sizes up to several staging buffers, written at every offset into a cache line. Empty
+// inputs are left out, since fpc_encode asserts on them in debug builds.
+#define MAX_COUNT 320
+#define LINE_SIZE 64
+#define GUARD 0xA5
+#define FCM_SIZE (1 << 10)
+#define DFCM_SIZE (1 << 10)
+
+double source_f64[MAX_COUNT];
+double decoded_f64[MAX_COUNT + 1];
+float source_f32[MAX_COUNT];
+float decoded_f32[MAX_COUNT + 1];
+uint8_t expected[FPC_UPPER_BOUND(MAX_COUNT)];
+uint8_t storage[FPC_UPPER_BOUND(MAX_COUNT) + LINE_SIZE * 3];
+uint64_t fcm_f64[FCM_SIZE];
+uint64_t dfcm_f64[DFCM_SIZE];
+uint32_t fcm_f32[FCM_SIZE];
+uint32_t dfcm_f32[DFCM_SIZE];
+
+uint8_t* line_start()
+{
+  return storage + LINE_SIZE - ((size_t)storage & (LINE_SIZE - 1));
+}
+
+void check_guard(const uint8_t* begin, const uint8_t* end)
+{
+  for (; begin != end; ++begin)
+    assert(*begin == GUARD);
+}
+
+void test_streaming()
+{
+  fpc_context_t c;
+  size_t i, count, offset, expected_size, encoded_size, decoded_size;
+  uint8_t* const line = line_start();
+  uint8_t* out;
+
+  fpc_context_init_default(&c, fcm_f64, dfcm_f64, FCM_SIZE, DFCM_SIZE);
+  // Residuals of every length, so the data stream crosses lines at every position.
+  for (i = 0; i != MAX_COUNT; ++i)
+    source_f64[i] = i % 3 ? (double)(i % 7) * 0.5 : (double)rand() / (double)rand();
+
+  for (count = 1; count != MAX_COUNT; ++count)
+  {
+    streaming_min_size = (size_t)-1;
+    fpc_context_reset(&c);
+    expected_size = fpc_encode(&c, source_f64, count, expected);
+
+    for (offset = 0; offset != LINE_SIZE; ++offset)
+    {
+      out = line + offset;
+      memset(storage, GUARD, sizeof(storage));
+      streaming_min_size = 0;
+      fpc_context_reset(&c);
+      encoded_size = fpc_encode(&c, source_f64, count, out);
+      assert(encoded_size == expected_size);
+      assert(memcmp(out, expected, encoded_size) == 0);
+      check_guard(storage, out);
+      check_guard(out + encoded_size, storage + sizeof(storage));
+
+      decoded_f64[count] = -1.0;
+      fpc_context_reset(&c);
+      decoded_size = fpc_decode(&c, out, decoded_f64, count);
+      assert(decoded_size == encoded_size);
+      assert(decoded_f64[count] == -1.0);
+      for (i = 0; i != count; ++i)
+        assert(source_f64[i] == decoded_f64[i]);
+    }
+  }
+  (void)expected_size;
+  (void)encoded_size;
+  (void)decoded_size;
+
+  printf("streaming test succeeded (%llu sizes at %llu offsets)\n",
+    (unsigned long long)MAX_COUNT, (unsigned long long)LINE_SIZE);
+}
+
+void test_streaming32()
+{
+  fpc32_context_t c;
+  size_t i, count, offset, expected_size, encoded_size, decoded_size;
+  uint8_t* const line = line_start();
+  uint8_t* out;
+
+  fpc32_context_init_default(&c, fcm_f32, dfcm_f32, FCM_SIZE, DFCM_SIZE);
+  for (i = 0; i != MAX_COUNT; ++i)
+    source_f32[i] = i % 3 ? (float)(i % 7) * 0.5f : (float)rand() / (float)rand();
+
+  for (count = 1; count != MAX_COUNT; ++count)
+  {
+    streaming_min_size = (size_t)-1;
+    fpc32_context_reset(&c);
+    expected_size = fpc32_encode(&c, source_f32, count, expected);
+
+    for (offset = 0; offset != LINE_SIZE; ++offset)
+    {
+      out = line + offset;
+      memset(storage, GUARD, sizeof(storage));
+      streaming_min_size = 0;
+      fpc32_context_reset(&c);
+      encoded_size = fpc32_encode(&c, source_f32, count, out);
+      assert(encoded_size == expected_size);
+      assert(memcmp(out, expected, encoded_size) == 0);
+      check_guard(storage, out);
+      check_guard(out + encoded_size, storage + sizeof(storage));
+
+      decoded_f32[count] = -1.0f;
+      fpc32_context_reset(&c);
+      decoded_size = fpc32_decode(&c, out, decoded_f32, count);
+      assert(decoded_size == encoded_size);
+      assert(decoded_f32[count] == -1.0f);
+      for (i = 0; i != count; ++i)
+        assert(source_f32[i] == decoded_f32[i]);
+    }
+  }
+  (void)expected_size;
+  (void)encoded_size;
+  (void)decoded_size;
+
+  printf("32-bit streaming test succeeded (%llu sizes at %llu offsets)\n",
+    (unsigned long long)MAX_COUNT, (unsigned long long)LINE_SIZE);
+}
+
+int main(
+  int argc,
+  const char** argv)
+{
+  (void)argc;
+  (void)argv;
+  srand(1);
+  test_streaming();
+  test_streaming32();
+  return 0;
+}